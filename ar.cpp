@@ -1,13 +1,63 @@
+#include <array>
 #include <iostream>
+#include <unordered_set>
+#include <utility>
 #include <fast-cpp-csv-parser/csv.h>
 #include "ar.h"
 #include "matrix.h"
 
+/// The columns of the probabilities of the characters in the RAxML-NG output, in the order of the codes
+#ifdef SEQ_TYPE_AA
+#define XPAS_ALGS_PROB_COLUMNS "p_A", "p_R", "p_N", "p_D", "p_C", "p_Q", "p_E", "p_G", "p_H", "p_I", \
+                               "p_L", "p_K", "p_M", "p_F", "p_P", "p_S", "p_T", "p_W", "p_Y", "p_V"
+#else
+#define XPAS_ALGS_PROB_COLUMNS "p_A", "p_C", "p_G", "p_T"
+#endif
+
+using csv_reader = ::io::CSVReader<1 + sigma,
+                                   ::io::trim_chars<' '>,
+                                   ::io::no_quote_escape<'\t'>,
+                                   ::io::throw_on_overflow,
+                                   ::io::single_and_empty_line_comment<'.'>>;
+
+struct raxmlng_reader::stream
+{
+    explicit stream(const std::string& file_name)
+        : in(file_name)
+    {
+        in.read_header(::io::ignore_extra_column, "Node", XPAS_ALGS_PROB_COLUMNS);
+    }
+
+    csv_reader in;
+
+    /// The first row of the next node, read while looking for the end of the current one
+    std::string next_label;
+    matrix::column next_column;
+
+    /// The nodes returned so far, to catch the files where the rows of a node are not contiguous
+    std::unordered_set<std::string> done;
+};
+
+using probabilities = std::array<score_t, sigma>;
+
+template<size_t... I>
+static bool read_row(csv_reader& in, std::string& node_label, probabilities& row, std::index_sequence<I...>)
+{
+    return in.read_row(node_label, row[I]...);
+}
+
+/// Reads the label and the probabilities of the characters of a row
+static bool read_row(csv_reader& in, std::string& node_label, probabilities& row)
+{
+    return read_row(in, node_label, row, std::make_index_sequence<sigma>());
+}
 
 raxmlng_reader::raxmlng_reader(const std::string& file_name) noexcept
     : _file_name{ file_name }
 {}
 
+raxmlng_reader::~raxmlng_reader() noexcept = default;
+
 ar_result raxmlng_reader::read()
 {
     try
@@ -29,21 +79,64 @@ ar_result raxmlng_reader::read_matrix()
     // column-based
     ar_result result;
 
-    ::io::CSVReader<5,
-            ::io::trim_chars<' '>,
-            ::io::no_quote_escape<'\t'>,
-            ::io::throw_on_overflow,
-            ::io::single_and_empty_line_comment<'.'>> _in(_file_name);
+    csv_reader _in(_file_name);
 
-        _in.read_header(::io::ignore_extra_column, "Node", "p_A", "p_C", "p_G", "p_T");
+        _in.read_header(::io::ignore_extra_column, "Node", XPAS_ALGS_PROB_COLUMNS);
 
         std::string node_label;
-        score_t a, c, g, t;
-        while (_in.read_row(node_label, a, c, g, t))
+        probabilities row;
+        while (read_row(_in, node_label, row))
         {
-            auto new_column = std::vector<score_t>{ a, c, g, t };
+            auto new_column = std::vector<score_t>(row.begin(), row.end());
             result[node_label].get_data().push_back(new_column);
         }
 
         return result;
-}
\ No newline at end of file
+}
+
+std::optional<std::pair<std::string, matrix>> raxmlng_reader::read_next()
+{
+    try
+    {
+        if (!_stream)
+        {
+            _stream = std::make_unique<stream>(_file_name);
+        }
+
+        std::optional<std::pair<std::string, matrix>> result;
+        if (!_stream->next_label.empty())
+        {
+            result.emplace(std::move(_stream->next_label), matrix());
+            result->second.get_data().push_back(std::move(_stream->next_column));
+            _stream->next_label.clear();
+        }
+
+        std::string node_label;
+        probabilities row;
+        while (read_row(_stream->in, node_label, row))
+        {
+            if (!result)
+            {
+                result.emplace(node_label, matrix());
+            }
+            else if (node_label != result->first)
+            {
+                _stream->next_label = std::move(node_label);
+                _stream->next_column.assign(row.begin(), row.end());
+                break;
+            }
+            result->second.get_data().emplace_back(row.begin(), row.end());
+        }
+
+        if (result && !_stream->done.insert(result->first).second)
+        {
+            throw std::runtime_error("RAXML-NG result parsing error: the rows of node " + result->first +
+                                     " are not contiguous");
+        }
+        return result;
+    }
+    catch (::io::error::integer_overflow& error)
+    {
+        throw std::runtime_error("RAXML-NG result parsing error: " + std::string(error.what()));
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef XPAS_ALGS_AR_H
 #define XPAS_ALGS_AR_H
 
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -16,14 +18,22 @@ public:
     raxmlng_reader(raxmlng_reader&&) = delete;
     raxmlng_reader& operator=(const raxmlng_reader&) = delete;
     raxmlng_reader& operator=(raxmlng_reader&&) = delete;
-    ~raxmlng_reader() noexcept = default;
+    ~raxmlng_reader() noexcept;
 
     ar_result read();
 
+    /// Reads the file one node at a time: returns the matrix of the next node, or nothing at the end
+    /// of the file. The rows of a node have to be contiguous, as RAxML-NG writes them
+    std::optional<std::pair<std::string, matrix>> read_next();
+
 private:
     ar_result read_matrix();
 
     std::string _file_name;
+
+    /// The parser of read_next and the row read ahead of the current node
+    struct stream;
+    std::unique_ptr<stream> _stream;
 };
 
 #endif //XPAS_ALGS_AR_H
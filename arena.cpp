@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "arena.h"
+
+/// The smallest capacity allocated, in k-mers
+static const size_t min_arena_capacity = 1024;
+
+/// The size of a transparent huge page on x86-64 and most ARM64 configurations
+static const size_t huge_page_size = size_t{ 2 } << 20;
+
+kmer_arena::kmer_arena(bool huge_pages)
+    : _data(nullptr), _size(0), _capacity(0)
+#ifdef __linux__
+    , _huge_pages(huge_pages)
+#else
+    , _huge_pages(false)
+#endif
+{
+    (void)huge_pages;
+}
+
+kmer_arena::~kmer_arena() noexcept
+{
+    release();
+}
+
+void kmer_arena::reserve(size_t capacity)
+{
+    if (capacity > _capacity)
+    {
+        grow(capacity);
+    }
+}
+
+void kmer_arena::clear()
+{
+    _size = 0;
+}
+
+size_t kmer_arena::size() const
+{
+    return _size;
+}
+
+size_t kmer_arena::capacity() const
+{
+    return _capacity;
+}
+
+bool kmer_arena::empty() const
+{
+    return _size == 0;
+}
+
+phylo_kmer* kmer_arena::begin()
+{
+    return _data;
+}
+
+phylo_kmer* kmer_arena::end()
+{
+    return _data + _size;
+}
+
+const phylo_kmer* kmer_arena::begin() const
+{
+    return _data;
+}
+
+const phylo_kmer* kmer_arena::end() const
+{
+    return _data + _size;
+}
+
+std::vector<phylo_kmer> kmer_arena::to_vector() const
+{
+    return { begin(), end() };
+}
+
+void kmer_arena::grow(size_t min_capacity)
+{
+    auto capacity = std::max({ min_capacity, 2 * _capacity, min_arena_capacity });
+
+#ifdef __linux__
+    if (_huge_pages)
+    {
+        /// Whole huge pages, the rest of the last one would be wasted anyway
+        auto num_bytes = capacity * sizeof(phylo_kmer);
+        num_bytes = (num_bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        capacity = num_bytes / sizeof(phylo_kmer);
+
+        void* data = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        // only a hint, the kernel may not support it
+        madvise(data, num_bytes, MADV_HUGEPAGE);
+
+        if (_size > 0)
+        {
+            std::memcpy(data, _data, _size * sizeof(phylo_kmer));
+        }
+        const auto size = _size;
+        release();
+        _data = static_cast<phylo_kmer*>(data);
+        _size = size;
+        _capacity = capacity;
+        return;
+    }
+#endif
+
+    auto* data = static_cast<phylo_kmer*>(std::realloc(_data, capacity * sizeof(phylo_kmer)));
+    if (data == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    _data = data;
+    _capacity = capacity;
+}
+
+void kmer_arena::release() noexcept
+{
+    if (_data == nullptr)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    if (_huge_pages)
+    {
+        munmap(_data, _capacity * sizeof(phylo_kmer));
+    }
+    else
+    {
+        std::free(_data);
+    }
+#else
+    std::free(_data);
+#endif
+
+    _data = nullptr;
+    _size = 0;
+    _capacity = 0;
+}
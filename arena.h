@@ -0,0 +1,62 @@
+#ifndef XPAS_ALGS_ARENA_H
+#define XPAS_ALGS_ARENA_H
+
+#include "common.h"
+
+/// A growable buffer of k-mers owned by the caller and reused across windows on the same thread.
+/// clear() keeps the memory, so after the first few windows nothing is allocated or page-faulted.
+/// The buffer grows geometrically on demand. With huge pages, it is mapped directly
+/// and advised to be backed by transparent huge pages (Linux only, ignored elsewhere).
+///
+/// An arena is a sink: engines can emit into it.
+class kmer_arena
+{
+public:
+    explicit kmer_arena(bool huge_pages = false);
+    kmer_arena(const kmer_arena&) = delete;
+    kmer_arena(kmer_arena&&) = delete;
+    kmer_arena& operator=(const kmer_arena&) = delete;
+    kmer_arena& operator=(kmer_arena&&) = delete;
+    ~kmer_arena() noexcept;
+
+    void emit(code_t kmer, score_t score)
+    {
+        if (_size == _capacity)
+        {
+            grow(_size + 1);
+        }
+        _data[_size++] = { kmer, score };
+    }
+
+    void reserve(size_t capacity);
+
+    /// Forgets the k-mers, keeps the memory
+    void clear();
+
+    size_t size() const;
+
+    size_t capacity() const;
+
+    bool empty() const;
+
+    phylo_kmer* begin();
+    phylo_kmer* end();
+
+    const phylo_kmer* begin() const;
+    const phylo_kmer* end() const;
+
+    std::vector<phylo_kmer> to_vector() const;
+
+private:
+    void grow(size_t min_capacity);
+
+    void release() noexcept;
+
+    phylo_kmer* _data;
+    size_t _size;
+    size_t _capacity;
+
+    bool _huge_pages;
+};
+
+#endif //XPAS_ALGS_ARENA_H
@@ -0,0 +1,228 @@
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
+
+#include "autotune.h"
+
+/// The number of features of the linear model, including the intercept
+static const size_t num_features = 6;
+
+static std::vector<double> as_vector(const window_features& features)
+{
+    return {
+        1.0,
+        static_cast<double>(features.k),
+        features.omega,
+        features.log_best,
+        features.entropy,
+        features.log_size
+    };
+}
+
+window_features get_features(const window& window, size_t k, score_t omega)
+{
+    const auto eps = get_threshold(omega, k);
+    const auto best = window.range_product(0, k);
+
+    score_t entropy = 0.0f;
+    score_t log_size = 0.0f;
+    for (size_t j = 0; j < k; ++j)
+    {
+        entropy += shannon(window.get_column(j));
+
+        // The number of characters of the column that can be a part of a k-mer over the threshold
+        const auto best_others = best / window.max_at(j).second;
+        size_t alive = 0;
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            if (window.get(i, j) * best_others > eps)
+            {
+                ++alive;
+            }
+        }
+        log_size += std::log(static_cast<score_t>(std::max(alive, size_t{ 1 })));
+    }
+
+    return { k, omega, std::log(best), entropy / static_cast<score_t>(k), log_size };
+}
+
+/// Solves the linear system a * x = b by Gaussian elimination with partial pivoting
+static std::vector<double> solve(std::vector<std::vector<double>> a, std::vector<double> b)
+{
+    const auto n = b.size();
+    for (size_t col = 0; col < n; ++col)
+    {
+        size_t pivot = col;
+        for (size_t row = col + 1; row < n; ++row)
+        {
+            if (std::fabs(a[row][col]) > std::fabs(a[pivot][col]))
+            {
+                pivot = row;
+            }
+        }
+        std::swap(a[col], a[pivot]);
+        std::swap(b[col], b[pivot]);
+
+        if (std::fabs(a[col][col]) < std::numeric_limits<double>::epsilon())
+        {
+            continue;
+        }
+
+        for (size_t row = col + 1; row < n; ++row)
+        {
+            const auto factor = a[row][col] / a[col][col];
+            for (size_t c = col; c < n; ++c)
+            {
+                a[row][c] -= factor * a[col][c];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+
+    std::vector<double> x(n, 0.0);
+    for (size_t row = n; row-- > 0;)
+    {
+        if (std::fabs(a[row][row]) < std::numeric_limits<double>::epsilon())
+        {
+            continue;
+        }
+
+        double sum = b[row];
+        for (size_t c = row + 1; c < n; ++c)
+        {
+            sum -= a[row][c] * x[c];
+        }
+        x[row] = sum / a[row][row];
+    }
+    return x;
+}
+
+cost_model cost_model::fit(const std::vector<tuning_sample>& samples)
+{
+    // The normal equations of the least squares fit of log(1 + time), per algorithm
+    std::map<algorithm, std::vector<std::vector<double>>> xtx;
+    std::map<algorithm, std::vector<double>> xty;
+
+    for (const auto& [alg, features, time] : samples)
+    {
+        if (xtx.find(alg) == xtx.end())
+        {
+            xtx[alg] = std::vector<std::vector<double>>(num_features, std::vector<double>(num_features, 0.0));
+            xty[alg] = std::vector<double>(num_features, 0.0);
+        }
+
+        const auto x = as_vector(features);
+        const auto y = std::log1p(static_cast<double>(time));
+        for (size_t i = 0; i < num_features; ++i)
+        {
+            for (size_t j = 0; j < num_features; ++j)
+            {
+                xtx[alg][i][j] += x[i] * x[j];
+            }
+            xty[alg][i] += x[i] * y;
+        }
+    }
+
+    cost_model model;
+    for (auto& [alg, a] : xtx)
+    {
+        // A small ridge term keeps the system solvable if a feature is constant over the samples
+        for (size_t i = 0; i < num_features; ++i)
+        {
+            a[i][i] += 1e-6 * (1.0 + a[i][i]);
+        }
+        model._weights[alg] = solve(a, xty[alg]);
+    }
+    return model;
+}
+
+cost_model cost_model::load(const std::string& filename)
+{
+    std::ifstream file(filename);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open the cost model: " + filename);
+    }
+
+    cost_model model;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream stream(line);
+        std::string name;
+        stream >> name;
+
+        std::vector<double> weights(num_features);
+        for (auto& w : weights)
+        {
+            if (!(stream >> w))
+            {
+                throw std::runtime_error("Wrong cost model format: " + filename);
+            }
+        }
+        model._weights[algorithm_from_string(name)] = weights;
+    }
+    return model;
+}
+
+void cost_model::save(const std::string& filename) const
+{
+    std::ofstream file(filename);
+    file << "# log(1 + time): weights of 1, k, omega, log_best, entropy, log_size" << std::endl;
+    file.precision(std::numeric_limits<double>::max_digits10);
+    for (const auto& [alg, weights] : _weights)
+    {
+        file << to_string(alg);
+        for (const auto& w : weights)
+        {
+            file << " " << w;
+        }
+        file << std::endl;
+    }
+}
+
+score_t cost_model::predict(algorithm alg, const window_features& features) const
+{
+    const auto& weights = _weights.at(alg);
+    const auto x = as_vector(features);
+
+    double y = 0.0;
+    for (size_t i = 0; i < num_features; ++i)
+    {
+        y += weights[i] * x[i];
+    }
+    return static_cast<score_t>(std::expm1(y));
+}
+
+algorithm cost_model::choose(const window_features& features) const
+{
+    if (_weights.empty())
+    {
+        throw std::runtime_error("The cost model is not calibrated");
+    }
+
+    auto best_alg = _weights.begin()->first;
+    auto best_time = std::numeric_limits<score_t>::max();
+    for (const auto& [alg, weights] : _weights)
+    {
+        const auto time = predict(alg, features);
+        if (time < best_time)
+        {
+            best_time = time;
+            best_alg = alg;
+        }
+    }
+    return best_alg;
+}
+
+bool cost_model::empty() const
+{
+    return _weights.empty();
+}
@@ -0,0 +1,62 @@
+#ifndef XPAS_ALGS_AUTOTUNE_H
+#define XPAS_ALGS_AUTOTUNE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "matrix.h"
+
+/// Cheap features of a window that the running time of the algorithms depends on
+struct window_features
+{
+    size_t k;
+    score_t omega;
+
+    // log of the best k-mer score of the window
+    score_t log_best;
+
+    // the mean Shannon entropy of the columns
+    score_t entropy;
+
+    // log of the estimated number of k-mers with the score over the threshold
+    score_t log_size;
+};
+
+window_features get_features(const window& window, size_t k, score_t omega);
+
+/// One measurement used to calibrate the cost model: features of a window
+/// and the running time of an algorithm on it
+struct tuning_sample
+{
+    algorithm alg;
+    window_features features;
+    unsigned long time;
+};
+
+/// Predicts the running time of the algorithms on a window by a linear model
+/// of log(time) fitted to the measurements of previous runs
+class cost_model
+{
+public:
+    cost_model() = default;
+
+    static cost_model fit(const std::vector<tuning_sample>& samples);
+
+    static cost_model load(const std::string& filename);
+
+    void save(const std::string& filename) const;
+
+    /// The predicted running time in microseconds
+    score_t predict(algorithm alg, const window_features& features) const;
+
+    /// The calibrated algorithm with the lowest predicted running time
+    algorithm choose(const window_features& features) const;
+
+    bool empty() const;
+
+private:
+    std::map<algorithm, std::vector<double>> _weights;
+};
+
+#endif //XPAS_ALGS_AUTOTUNE_H
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "bands.h"
+
+omega_bands::omega_bands(std::vector<score_t> omegas, size_t k)
+    : _omegas(std::move(omegas))
+{
+    if (_omegas.empty())
+    {
+        throw std::runtime_error("No omega values given");
+    }
+
+    std::sort(_omegas.begin(), _omegas.end());
+    _omegas.erase(std::unique(_omegas.begin(), _omegas.end()), _omegas.end());
+
+    for (const auto omega : _omegas)
+    {
+        _thresholds.push_back(get_threshold(omega, k));
+    }
+    _bands.resize(_omegas.size());
+}
+
+score_t omega_bands::min_omega() const
+{
+    return _omegas.front();
+}
+
+const std::vector<score_t>& omega_bands::get_omegas() const
+{
+    return _omegas;
+}
+
+size_t omega_bands::band(score_t score) const
+{
+    // The number of thresholds strictly below the score, minus the smallest one
+    const auto it = std::lower_bound(_thresholds.begin(), _thresholds.end(), score);
+    const auto num_passed = static_cast<size_t>(std::distance(_thresholds.begin(), it));
+    return num_passed > 0 ? num_passed - 1 : 0;
+}
+
+void omega_bands::add(const phylo_kmer& kmer)
+{
+    _bands[band(kmer.score)].push_back(kmer);
+}
+
+void omega_bands::add(const std::vector<phylo_kmer>& kmers)
+{
+    for (const auto& kmer : kmers)
+    {
+        add(kmer);
+    }
+}
+
+void omega_bands::clear()
+{
+    for (auto& band : _bands)
+    {
+        band.clear();
+    }
+}
+
+const std::vector<phylo_kmer>& omega_bands::get_band(size_t b) const
+{
+    return _bands[b];
+}
+
+size_t omega_bands::get_num_kmers(size_t b) const
+{
+    size_t num_kmers = 0;
+    for (size_t i = b; i < _bands.size(); ++i)
+    {
+        num_kmers += _bands[i].size();
+    }
+    return num_kmers;
+}
+
+size_t omega_bands::size() const
+{
+    return _bands.size();
+}
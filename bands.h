@@ -0,0 +1,44 @@
+#ifndef XPAS_ALGS_BANDS_H
+#define XPAS_ALGS_BANDS_H
+
+#include "common.h"
+
+/// Splits k-mers enumerated once at the smallest omega into bands by the thresholds of several omegas.
+/// The results for a larger omega are exactly the k-mers of the smaller one with the score over its
+/// threshold, so the band b holds the k-mers with eps(omega_b) < score <= eps(omega_{b+1}),
+/// and the result for omega_b is the union of the bands b, b + 1, ...
+class omega_bands
+{
+public:
+    omega_bands(std::vector<score_t> omegas, size_t k);
+
+    /// The omega to enumerate at
+    score_t min_omega() const;
+
+    const std::vector<score_t>& get_omegas() const;
+
+    /// The band of a score over the smallest threshold
+    size_t band(score_t score) const;
+
+    void add(const phylo_kmer& kmer);
+
+    void add(const std::vector<phylo_kmer>& kmers);
+
+    void clear();
+
+    /// The k-mers with the score in the band b
+    const std::vector<phylo_kmer>& get_band(size_t b) const;
+
+    /// The number of k-mers over the threshold of omega_b
+    size_t get_num_kmers(size_t b) const;
+
+    size_t size() const;
+
+private:
+    std::vector<score_t> _omegas;
+    std::vector<score_t> _thresholds;
+
+    std::vector<std::vector<phylo_kmer>> _bands;
+};
+
+#endif //XPAS_ALGS_BANDS_H
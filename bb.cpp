@@ -1,7 +1,20 @@
 #include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <limits>
 
 #include "bb.h"
 
+static std::vector<std::vector<size_t>> sort_columns(const window& window);
+
+/// A threshold lowered by the rounding error of a product of k scores, for bounds computed
+/// in another order than the scores of branch-and-bound
+score_t lower_by_rounding(score_t eps, size_t k)
+{
+    return eps * (1.0f - 2.0f * static_cast<score_t>(k) * std::numeric_limits<score_t>::epsilon());
+}
+
 branch_and_bound::branch_and_bound(const window& window, size_t k, score_t omega)
         : _window(window)
         , _k(k)
@@ -16,23 +29,16 @@ branch_and_bound::branch_and_bound(const window& window, size_t k, score_t omega
     {
         throw std::runtime_error("The size of the window is not k");
     }
-
-    _result_list.reserve(
-        static_cast<int>(std::pow((sigma / omega), k))
-    );
+    (void)omega;
 
     preprocess();
 }
 
 void branch_and_bound::run(score_t omega)
 {
-    const score_t eps = get_threshold(omega, _k);
-
     // Recursive BB
-    for (size_t i = 0; i < sigma; ++i)
-    {
-        bb(i, 0, 0, 1.0, eps);
-    }
+    vector_sink sink(_result_list);
+    run(omega, sink);
 
     // Iterative BB
     /*
@@ -56,7 +62,7 @@ void branch_and_bound::run(score_t omega)
                 const auto best_suffix = _best_suffix_score[_k - (j + 1)];
                 if (new_score * best_suffix > eps)
                 {
-                    const auto new_prefix = (prefix << 2) | i;
+                    const auto new_prefix = (prefix << bit_length) | i;
                     _stack.push_back({new_prefix, new_score, static_cast<unsigned short>(j + 1u)});
                 }
 
@@ -67,38 +73,8 @@ void branch_and_bound::run(score_t omega)
 
 bb_return branch_and_bound::bb(size_t i, size_t j, code_t prefix, score_t score, score_t eps)
 {
-    // score = score + _matrix[i][j];
-    score = score * _window.get(i, j);
-    prefix = (prefix << 2) | i;
-
-    if (j == _k - 1)
-    {
-        if (score > eps)
-        {
-            _result_list.push_back({prefix, score});
-            //_map[prefix] = score;
-            return bb_return::GOOD_KMER;
-        }
-        else
-        {
-            return bb_return::BAD_PREFIX;
-        }
-    }
-
-    const auto best_suffix = _best_suffix_score[_k - (j + 2)];
-    //if (score + best_suffix <= eps)
-    if (score * best_suffix <= eps)
-    {
-        return bb_return::BAD_PREFIX;
-    }
-    else
-    {
-        for (size_t i2 = 0; i2 < sigma; ++i2)
-        {
-            bb(i2, j + 1, prefix, score, eps);
-        }
-        return bb_return::GOOD_PRFIX;
-    }
+    vector_sink sink(_result_list);
+    return bb(i, j, prefix, score, eps, sink);
 }
 
 /*
@@ -133,23 +109,471 @@ void branch_and_bound::preprocess()
     //_best_suffix_score.push_back(1.0f);
 
     // precalc the scores of the best suffixes
-    code_t prefix = 0;
     //score_t score = 0.0;
     score_t score = 1.0;
     for (size_t i = 0; i < _k; ++i)
     {
-        const auto& [index_best, score_best] = _window.max_at(_k - i - 1);
+        const auto score_best = _window.max_at(_k - i - 1).second;
 
-        prefix = (index_best << i * 2) | prefix;
         //score = score + score_best;
         score = score * score_best;
 
         //std::cout << "BEST: " << kmer_score << std::endl;
         _best_suffix_score.push_back(score);
     }
+
+    if constexpr (sorted_columns)
+    {
+        _order = sort_columns(_window);
+    }
+}
+
+
+
+sliding_bb::sliding_bb(const window& window, std::vector<phylo_kmer>& suffixes, size_t k, score_t lookahead)
+    : _window(window)
+    , _k(k)
+    , _lookahead(lookahead)
+    , _best_completion(0.0f)
+    , _suffixes(suffixes)
+{
+    if (_window.empty())
+    {
+        throw std::runtime_error("The matrix is empty.");
+    }
+
+    if (_window.size() != k)
+    {
+        throw std::runtime_error("The size of the window is not k");
+    }
+
+    if (k < 2)
+    {
+        throw std::runtime_error("Sliding branch-and-bound requires k > 1");
+    }
+
+    preprocess();
+}
+
+void sliding_bb::run(score_t omega)
+{
+    vector_sink sink(_result_list);
+    run(omega, sink);
+}
+
+void sliding_bb::bb(size_t i, size_t j, code_t prefix, score_t score, score_t eps)
+{
+    score = score * _window.get(i, j);
+    prefix = (prefix << bit_length) | i;
+
+    if (j == _k - 1)
+    {
+        if (score * _best_completion > eps)
+        {
+            _suffixes.push_back({prefix, score});
+        }
+        return;
+    }
+
+    const auto best_suffix = _best_suffix_score[_k - (j + 1)];
+    if (score * best_suffix * _best_completion > eps)
+    {
+        for (size_t i2 = 0; i2 < sigma; ++i2)
+        {
+            bb(i2, j + 1, prefix, score, eps);
+        }
+    }
+}
+
+score_t sliding_bb::left_to_right(code_t kmer) const
+{
+    const code_t mask = (code_t{ 1 } << bit_length) - 1;
+    score_t score = 1.0;
+    for (size_t j = 0; j < _k; ++j)
+    {
+        const auto i = static_cast<size_t>((kmer >> ((_k - 1 - j) * bit_length)) & mask);
+        score = score * _window.get(i, j);
+    }
+    return score;
+}
+
+const std::vector<phylo_kmer>& sliding_bb::get_result() const
+{
+    return _result_list;
+}
+
+size_t sliding_bb::get_num_kmers() const
+{
+    return _result_list.size();
+}
+
+void sliding_bb::preprocess()
+{
+    // The best scores of the suffixes of the columns [1, k)
+    score_t score = 1.0;
+    _best_suffix_score.push_back(score);
+    for (size_t j = _k - 1; j > 0; --j)
+    {
+        const auto& [index_best, score_best] = _window.max_at(j);
+        score = score * score_best;
+        _best_suffix_score.push_back(score);
+    }
+
+    const auto& [index_best, score_best] = _window.max_at(0);
+    _best_completion = std::max(score_best, _lookahead);
 }
 
 
+/// The characters of every column of the window in the order of decreasing score
+static std::vector<std::vector<size_t>> sort_columns(const window& window)
+{
+    std::vector<std::vector<size_t>> result;
+    for (size_t j = 0; j < window.size(); ++j)
+    {
+        std::vector<size_t> order(sigma);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+                  [&window, j](size_t a, size_t b) { return window.get(a, j) > window.get(b, j); });
+        result.push_back(std::move(order));
+    }
+    return result;
+}
+
+top_n::top_n(const window& window, size_t k, size_t n)
+    : _window(window)
+    , _k(k)
+    , _n(n)
+    , _threshold(0.0f)
+{
+    if (_window.empty())
+    {
+        throw std::runtime_error("The matrix is empty.");
+    }
+
+    if (_window.size() != k)
+    {
+        throw std::runtime_error("The size of the window is not k");
+    }
+
+    _heap.reserve(n);
+
+    preprocess();
+}
+
+void top_n::run(score_t omega)
+{
+    _threshold = get_threshold(omega, _k);
+
+    if (_n > 0)
+    {
+        bb(0, 0, 1.0);
+    }
+}
+
+void top_n::bb(size_t j, code_t prefix, score_t score)
+{
+    const auto best_suffix = _best_suffix_score[_k - (j + 1)];
+
+    for (const auto i : _order[j])
+    {
+        const auto new_score = score * _window.get(i, j);
+
+        // The characters go by decreasing score, the rest can not be better
+        if (new_score * best_suffix <= _threshold)
+        {
+            break;
+        }
+
+        const auto new_prefix = (prefix << bit_length) | i;
+        if (j == _k - 1)
+        {
+            push(new_prefix, new_score);
+        }
+        else
+        {
+            bb(j + 1, new_prefix, new_score);
+        }
+    }
+}
+
+void top_n::push(code_t kmer, score_t score)
+{
+    auto greater = [](const phylo_kmer& a, const phylo_kmer& b) { return a.score > b.score; };
+
+    if (_heap.size() == _n)
+    {
+        std::pop_heap(_heap.begin(), _heap.end(), greater);
+        _heap.pop_back();
+    }
+
+    _heap.push_back({ kmer, score });
+    std::push_heap(_heap.begin(), _heap.end(), greater);
+
+    if (_heap.size() == _n)
+    {
+        _threshold = std::max(_threshold, _heap.front().score);
+    }
+}
+
+std::vector<phylo_kmer> top_n::get_result() const
+{
+    auto result = _heap;
+    std::sort(result.begin(), result.end(), kmer_score_comparator);
+    return result;
+}
+
+size_t top_n::get_num_kmers() const
+{
+    return _heap.size();
+}
+
+void top_n::preprocess()
+{
+    // The best scores of the suffixes: _best_suffix_score[i] is the best score of the last i columns
+    score_t score = 1.0;
+    _best_suffix_score.push_back(score);
+    for (size_t j = _k; j-- > 1;)
+    {
+        score = score * _window.max_at(j).second;
+        _best_suffix_score.push_back(score);
+    }
+
+    _order = sort_columns(_window);
+}
+
+
+multi_k_bb::multi_k_bb(const window& window, std::vector<size_t> ks)
+    : _window(window)
+    , _ks(std::move(ks))
+{
+    if (_window.empty())
+    {
+        throw std::runtime_error("The matrix is empty.");
+    }
+
+    std::sort(_ks.begin(), _ks.end());
+    _ks.erase(std::unique(_ks.begin(), _ks.end()), _ks.end());
+    if (_ks.empty() || _ks.front() == 0)
+    {
+        throw std::runtime_error("Wrong values of k");
+    }
+
+    _k_max = _ks.back();
+    if (_window.size() != _k_max)
+    {
+        throw std::runtime_error("The size of the window is not the largest k");
+    }
+
+    _k_index = std::vector<size_t>(_k_max + 1, _ks.size());
+    for (size_t i = 0; i < _ks.size(); ++i)
+    {
+        _k_index[_ks[i]] = i;
+    }
+    _result_lists.resize(_ks.size());
+}
+
+void multi_k_bb::run(score_t omega)
+{
+    _thresholds.clear();
+    for (const auto k : _ks)
+    {
+        _thresholds.push_back(get_threshold(omega, k));
+    }
+
+    _extend_bound = std::vector<score_t>(_k_max + 1, std::numeric_limits<score_t>::max());
+    for (size_t d = 0; d < _k_max; ++d)
+    {
+        for (size_t i = 0; i < _ks.size(); ++i)
+        {
+            if (_ks[i] > d)
+            {
+                const auto bound = _thresholds[i] / _window.range_product(d, _ks[i] - d);
+                _extend_bound[d] = std::min(_extend_bound[d], bound);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        bb(i, 0, 0, 1.0);
+    }
+}
+
+void multi_k_bb::bb(size_t i, size_t j, code_t prefix, score_t score)
+{
+    score = score * _window.get(i, j);
+    prefix = (prefix << bit_length) | i;
+
+    // The prefix has the length d = j + 1
+    const auto d = j + 1;
+    const auto k_index = _k_index[d];
+    if (k_index < _ks.size() && score > _thresholds[k_index])
+    {
+        _result_lists[k_index].push_back({ prefix, score });
+    }
+
+    if (d < _k_max && score > _extend_bound[d])
+    {
+        for (size_t i2 = 0; i2 < sigma; ++i2)
+        {
+            bb(i2, j + 1, prefix, score);
+        }
+    }
+}
+
+const std::vector<size_t>& multi_k_bb::get_ks() const
+{
+    return _ks;
+}
+
+const std::vector<phylo_kmer>& multi_k_bb::get_result(size_t i) const
+{
+    return _result_lists[i];
+}
+
+size_t multi_k_bb::get_num_kmers(size_t i) const
+{
+    return _result_lists[i].size();
+}
+
+
+impl::lazy_bb_iterator::lazy_bb_iterator(lazy_bb* generator)
+    : _generator(generator)
+{
+    if (_generator)
+    {
+        _current = _generator->next();
+    }
+}
+
+impl::lazy_bb_iterator& impl::lazy_bb_iterator::operator++()
+{
+    _current = _generator->next();
+    return *this;
+}
+
+bool impl::lazy_bb_iterator::operator==(const lazy_bb_iterator& rhs) const noexcept
+{
+    // Only iterators that reached the end are equal
+    return !_current && !rhs._current;
+}
+
+bool impl::lazy_bb_iterator::operator!=(const lazy_bb_iterator& rhs) const noexcept
+{
+    return !(*this == rhs);
+}
+
+impl::lazy_bb_iterator::reference impl::lazy_bb_iterator::operator*() const noexcept
+{
+    return *_current;
+}
+
+lazy_bb::lazy_bb(const window& window, size_t k, score_t omega)
+    : _window(window)
+    , _k(k)
+    , _eps(get_threshold(omega, k))
+{
+    if (_window.empty())
+    {
+        throw std::runtime_error("The matrix is empty.");
+    }
+
+    if (_window.size() != k)
+    {
+        throw std::runtime_error("The size of the window is not k");
+    }
+
+    preprocess();
+
+    push(0, 1.0, 0, 0);
+}
+
+std::optional<phylo_kmer> lazy_bb::next()
+{
+    auto bound_less = [](const _node& a, const _node& b) { return a.bound < b.bound; };
+
+    while (!_heap.empty())
+    {
+        std::pop_heap(_heap.begin(), _heap.end(), bound_less);
+        auto node = _heap.back();
+        _heap.pop_back();
+
+        auto score = node.score;
+        auto prefix = node.prefix;
+        size_t j = node.j;
+        const size_t r = node.r;
+
+        // The next character of the column j for the same prefix
+        if (r + 1 < sigma)
+        {
+            push(prefix, score, j, r + 1);
+        }
+
+        // Follow the best characters down to a k-mer
+        size_t i = _order[j][r];
+        for (;;)
+        {
+            score = score * _window.get(i, j);
+            prefix = (prefix << bit_length) | i;
+
+            if (j == _k - 1)
+            {
+                break;
+            }
+
+            ++j;
+            i = _order[j][0];
+            push(prefix, score, j, 1);
+        }
+
+        if (score > _eps)
+        {
+            return phylo_kmer{ prefix, score };
+        }
+    }
+    return std::nullopt;
+}
+
+lazy_bb::const_iterator lazy_bb::begin()
+{
+    return { this };
+}
+
+lazy_bb::const_iterator lazy_bb::end() noexcept
+{
+    return { nullptr };
+}
+
+size_t lazy_bb::get_frontier_size() const
+{
+    return _heap.size();
+}
+
+void lazy_bb::push(code_t prefix, score_t score, size_t j, size_t r)
+{
+    const auto bound = score * _window.get(_order[j][r], j) * _best_suffix_score[_k - (j + 1)];
+    if (bound > _eps)
+    {
+        auto bound_less = [](const _node& a, const _node& b) { return a.bound < b.bound; };
+        _heap.push_back({ bound, score, prefix, static_cast<unsigned short>(j), static_cast<unsigned short>(r) });
+        std::push_heap(_heap.begin(), _heap.end(), bound_less);
+    }
+}
+
+void lazy_bb::preprocess()
+{
+    // The best scores of the suffixes: _best_suffix_score[i] is the best score of the last i columns
+    score_t score = 1.0;
+    _best_suffix_score.push_back(score);
+    for (size_t j = _k; j-- > 1;)
+    {
+        score = score * _window.max_at(j).second;
+        _best_suffix_score.push_back(score);
+    }
+
+    _order = sort_columns(_window);
+}
+
 
 bbe::bbe(const window& window, std::vector<column_data> order, size_t k)
     : _window(window), _order(std::move(order)), _k(k), _best_suffix_score(k)
@@ -184,8 +608,8 @@ bb_return bbe::bb(size_t i, size_t column_id, code_t prefix, score_t score, scor
 {
     const size_t j = _order[column_id].j;
     score = score * _window.get(i, j);
-    //prefix = (prefix << 2) | i;
-    prefix |= i << (2 * (_k - 1 - j));
+    //prefix = (prefix << bit_length) | i;
+    prefix |= static_cast<code_t>(i) << (bit_length * (_k - 1 - j));
 
     if (column_id == _k - 1)
     {
@@ -259,7 +683,7 @@ void baseline::run(score_t omega)
     const auto eps = get_threshold(omega, _k);
     for (size_t i = 0; i < _num_kmers; ++i)
     {
-        _result_list.push_back({i, eps});
+        _result_list.push_back({ static_cast<code_t>(i), eps });
     }
 }
 
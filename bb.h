@@ -1,14 +1,21 @@
 #ifndef XPAS_ALGS_BB_H
 #define XPAS_ALGS_BB_H
 
+#include <optional>
 #include "common.h"
 #include "matrix.h"
+#include "sink.h"
 
 class branch_and_bound
 {
 public:
     branch_and_bound(const window& window, size_t k, score_t omega);
     void run(score_t omega);
+
+    /// Passes the k-mers to the sink instead of storing them, get_result stays empty
+    template<typename Sink>
+    void run(score_t omega, Sink& sink);
+
     bb_return bb(size_t i, size_t j, code_t prefix, score_t score, score_t eps);
     const map_t& get_map();
 
@@ -23,11 +30,17 @@ private:
 
     void preprocess();
 
+    template<typename Sink>
+    bb_return bb(size_t i, size_t j, code_t prefix, score_t score, score_t eps, Sink& sink);
+
     const window& _window;
     size_t _k;
     std::vector<score_t> _best_suffix_score;
     std::vector<bb_return> _returns;
 
+    /// The characters of every column from the best to the worst, for big alphabets only
+    std::vector<std::vector<size_t>> _order;
+
     std::vector<phylo_kmer> _result_list;
 
     struct _mmer
@@ -40,6 +53,398 @@ private:
 };
 
 
+template<typename Sink>
+void branch_and_bound::run(score_t omega, Sink& sink)
+{
+    const score_t eps = get_threshold(omega, _k);
+
+    if constexpr (sorted_columns)
+    {
+        const auto best_suffix = _k > 1 ? _best_suffix_score[_k - 2] : 1.0f;
+        for (const auto i : _order[0])
+        {
+            if (_window.get(i, 0) * best_suffix <= eps)
+            {
+                break;
+            }
+            bb(i, 0, 0, 1.0, eps, sink);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            bb(i, 0, 0, 1.0, eps, sink);
+        }
+    }
+}
+
+template<typename Sink>
+bb_return branch_and_bound::bb(size_t i, size_t j, code_t prefix, score_t score, score_t eps, Sink& sink)
+{
+    // score = score + _matrix[i][j];
+    score = score * _window.get(i, j);
+    prefix = (prefix << bit_length) | i;
+
+    if (j == _k - 1)
+    {
+        if (score > eps)
+        {
+            sink.emit(prefix, score);
+            //_map[prefix] = score;
+            return bb_return::GOOD_KMER;
+        }
+        else
+        {
+            return bb_return::BAD_PREFIX;
+        }
+    }
+
+    const auto best_suffix = _best_suffix_score[_k - (j + 2)];
+    //if (score + best_suffix <= eps)
+    if (score * best_suffix <= eps)
+    {
+        return bb_return::BAD_PREFIX;
+    }
+    else
+    {
+        if constexpr (sorted_columns)
+        {
+            // The bound of the child is checked here in the same way as in the child,
+            // so the first character that fails it stops the worse ones
+            const auto next_best_suffix = (j + 2 < _k) ? _best_suffix_score[_k - (j + 3)] : 1.0f;
+            for (const auto i2 : _order[j + 1])
+            {
+                if (score * _window.get(i2, j + 1) * next_best_suffix <= eps)
+                {
+                    break;
+                }
+                bb(i2, j + 1, prefix, score, eps, sink);
+            }
+        }
+        else
+        {
+            for (size_t i2 = 0; i2 < sigma; ++i2)
+            {
+                bb(i2, j + 1, prefix, score, eps, sink);
+            }
+        }
+        return bb_return::GOOD_PRFIX;
+    }
+}
+
+
+/// The threshold lowered by the rounding error of a product of k scores
+score_t lower_by_rounding(score_t eps, size_t k);
+
+/// Branch-and-bound for stride-1 scans. Windows j and j + 1 share the columns [j + 1, j + k),
+/// so the (k-1)-mers of those columns are enumerated once, in the first window of the pair,
+/// under the bound of the best of the columns j and j + k. The k-mers of window j are obtained by
+/// prepending the column j to the surviving (k-1)-mers, those of window j + 1 by appending the column j + k.
+///
+/// The scores are the products of branch-and-bound, left to right. The bounds are taken with a threshold
+/// lowered by the rounding error, so the result is every k-mer whose score passes. Branch-and-bound rounds its own
+/// bounds, so the two can still differ by the k-mers within rounding of the threshold
+class sliding_bb
+{
+public:
+    /// suffixes are the (k-1)-mers saved by the previous window, or empty if there is nothing to reuse.
+    /// lookahead is the best score of the column j + k, or 0 if the window j + 1 will not be computed.
+    sliding_bb(const window& window, std::vector<phylo_kmer>& suffixes, size_t k, score_t lookahead);
+    void run(score_t omega);
+
+    /// Passes the k-mers to the sink instead of storing them, get_result stays empty
+    template<typename Sink>
+    void run(score_t omega, Sink& sink);
+
+    const std::vector<phylo_kmer>& get_result() const;
+
+    size_t get_num_kmers() const;
+private:
+    void preprocess();
+
+    void bb(size_t i, size_t j, code_t prefix, score_t score, score_t eps);
+
+    template<typename Sink>
+    void extend_left(score_t eps, Sink& sink);
+
+    template<typename Sink>
+    void extend_right(score_t eps, Sink& sink);
+
+    /// The score of a k-mer of the window, multiplied in the order of branch-and-bound
+    score_t left_to_right(code_t kmer) const;
+
+    const window& _window;
+    size_t _k;
+
+    // The second score bound for the shared (k-1)-mers: the best score of the column j + k
+    score_t _lookahead;
+
+    // The best score the shared (k-1)-mers can be completed with, in this window or the next one
+    score_t _best_completion;
+
+    std::vector<score_t> _best_suffix_score;
+
+    std::vector<phylo_kmer>& _suffixes;
+
+    std::vector<phylo_kmer> _result_list;
+};
+
+template<typename Sink>
+void sliding_bb::run(score_t omega, Sink& sink)
+{
+    const score_t eps = get_threshold(omega, _k);
+
+    // The previous window left the (k-1)-mers of the columns [1, k) of this window.
+    // Extend them to the right and drop them, they are not shared with the next window
+    if (!_suffixes.empty())
+    {
+        extend_right(eps, sink);
+        _suffixes.clear();
+        return;
+    }
+
+    // Otherwise, enumerate the (k-1)-mers of the columns [1, k) that survive either in this window
+    // or in the next one, and extend them to the left
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        bb(i, 1, 0, 1.0, lower_by_rounding(eps, _k));
+    }
+    extend_left(eps, sink);
+
+    // The next window is not going to be computed, nothing to share
+    if (_lookahead <= 0.0f)
+    {
+        _suffixes.clear();
+    }
+}
+
+template<typename Sink>
+void sliding_bb::extend_left(score_t eps, Sink& sink)
+{
+    const auto& [index_best, score_best] = _window.max_at(0);
+    const auto shift = (_k - 1) * bit_length;
+    const auto near_eps = lower_by_rounding(eps, _k);
+
+    for (const auto& [suffix, suffix_score] : _suffixes)
+    {
+        // Survived only for the next window
+        if (suffix_score * score_best <= near_eps)
+        {
+            continue;
+        }
+
+        for (code_t i = 0; i < sigma; ++i)
+        {
+            // c0 * (c1 * ... * ck-1) can round to the other side of eps than ((c0 * c1) * ...) * ck-1,
+            // the k-mers that may pass are scored again in the order of branch-and-bound
+            if (_window.get(i, 0) * suffix_score > near_eps)
+            {
+                const auto kmer = (i << shift) | suffix;
+                const auto score = left_to_right(kmer);
+                if (score > eps)
+                {
+                    sink.emit(kmer, score);
+                }
+            }
+        }
+    }
+}
+
+template<typename Sink>
+void sliding_bb::extend_right(score_t eps, Sink& sink)
+{
+    const auto& [index_best, score_best] = _window.max_at(_k - 1);
+    const auto near_eps = lower_by_rounding(eps, _k);
+
+    // The prefixes were multiplied left to right, the scores are the ones of branch-and-bound
+    for (const auto& [prefix, prefix_score] : _suffixes)
+    {
+        // Survived only for the previous window
+        if (prefix_score * score_best <= near_eps)
+        {
+            continue;
+        }
+
+        for (code_t i = 0; i < sigma; ++i)
+        {
+            const auto score = prefix_score * _window.get(i, _k - 1);
+            if (score > eps)
+            {
+                sink.emit((prefix << bit_length) | i, score);
+            }
+        }
+    }
+}
+
+
+/// Branch-and-bound that keeps only the n best k-mers of the window. The k-mers are kept in
+/// a bounded min-heap; once it is full, its minimum becomes the threshold, which tightens
+/// as the search goes. The characters of every column are explored in the order of decreasing
+/// score, so good k-mers are found early and the memory stays O(n).
+class top_n
+{
+public:
+    top_n(const window& window, size_t k, size_t n);
+
+    /// omega gives the score floor, omega = 0 means no floor
+    void run(score_t omega);
+
+    /// Passes the n best k-mers to the sink once the search is over, in no particular order
+    template<typename Sink>
+    void run(score_t omega, Sink& sink);
+
+    /// The n best k-mers in the order of decreasing score
+    std::vector<phylo_kmer> get_result() const;
+
+    size_t get_num_kmers() const;
+private:
+    void preprocess();
+
+    void bb(size_t j, code_t prefix, score_t score);
+
+    void push(code_t kmer, score_t score);
+
+    const window& _window;
+    size_t _k;
+    size_t _n;
+
+    // The current threshold: the floor, or the minimum of the heap if it is full
+    score_t _threshold;
+
+    std::vector<score_t> _best_suffix_score;
+
+    // The characters of every column in the order of decreasing score
+    std::vector<std::vector<size_t>> _order;
+
+    // A min-heap by score
+    std::vector<phylo_kmer> _heap;
+};
+
+template<typename Sink>
+void top_n::run(score_t omega, Sink& sink)
+{
+    run(omega);
+    for (const auto& [kmer, score] : _heap)
+    {
+        sink.emit(kmer, score);
+    }
+}
+
+
+/// Branch-and-bound for several values of k from the same start position. The prefixes are shared:
+/// a prefix of length d is explored further if it can still become a k-mer over the threshold
+/// of some k > d, and it is a result for k = d if its score is over the threshold of that k.
+/// The window must be of the size of the largest k.
+class multi_k_bb
+{
+public:
+    multi_k_bb(const window& window, std::vector<size_t> ks);
+    void run(score_t omega);
+
+    const std::vector<size_t>& get_ks() const;
+
+    /// The results for the i-th value of k, in increasing order of k
+    const std::vector<phylo_kmer>& get_result(size_t i) const;
+
+    size_t get_num_kmers(size_t i) const;
+private:
+    void bb(size_t i, size_t j, code_t prefix, score_t score);
+
+    const window& _window;
+    std::vector<size_t> _ks;
+    size_t _k_max;
+
+    // The index of the prefix length in _ks, or the number of ks if it is not in the set
+    std::vector<size_t> _k_index;
+
+    // The thresholds for every k
+    std::vector<score_t> _thresholds;
+
+    // The score a prefix of length d needs to be extended: the minimum over k > d of eps(k) / best(d, k)
+    std::vector<score_t> _extend_bound;
+
+    std::vector<std::vector<phylo_kmer>> _result_lists;
+};
+
+
+class lazy_bb;
+
+namespace impl
+{
+    class lazy_bb_iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using reference = const phylo_kmer&;
+
+        lazy_bb_iterator(lazy_bb* generator);
+
+        lazy_bb_iterator& operator++();
+
+        bool operator==(const lazy_bb_iterator& rhs) const noexcept;
+        bool operator!=(const lazy_bb_iterator& rhs) const noexcept;
+
+        reference operator*() const noexcept;
+    private:
+        lazy_bb* _generator;
+
+        std::optional<phylo_kmer> _current;
+    };
+}
+
+/// Best-first branch-and-bound that yields the k-mers of the window one by one
+/// in the order of non-increasing score. Nothing is enumerated in advance.
+///
+/// The frontier is a max-heap of prefixes extended by one character, ordered by the upper bound
+/// of their score. The best child of a prefix has the same bound as the prefix, so the top of
+/// the heap is followed down the best characters to a k-mer, pushing only the next sibling
+/// at every level. Every next() costs O(k log frontier), and the frontier grows by at most k per k-mer.
+class lazy_bb
+{
+public:
+    using const_iterator = impl::lazy_bb_iterator;
+
+    lazy_bb(const window& window, size_t k, score_t omega);
+
+    /// The next best k-mer, or nothing if no k-mer over the threshold is left
+    std::optional<phylo_kmer> next();
+
+    [[nodiscard]]
+    const_iterator begin();
+
+    [[nodiscard]]
+    const_iterator end() noexcept;
+
+    size_t get_frontier_size() const;
+private:
+    /// A prefix of length j extended with the character of the rank r in the column j
+    struct _node
+    {
+        score_t bound;
+        score_t score;
+        code_t prefix;
+        unsigned short j;
+        unsigned short r;
+    };
+
+    void preprocess();
+
+    void push(code_t prefix, score_t score, size_t j, size_t r);
+
+    const window& _window;
+    size_t _k;
+    score_t _eps;
+
+    std::vector<score_t> _best_suffix_score;
+
+    // The characters of every column in the order of decreasing score
+    std::vector<std::vector<size_t>> _order;
+
+    std::vector<_node> _heap;
+};
+
+
 // A struct for the ordering of columns
 struct column_data
 {
@@ -9,7 +9,7 @@ brute_force::brute_force(const window& window, size_t k)
 
 void brute_force::run(score_t omega)
 {
-    const score_t eps = std::pow((omega / 4), _k);
+    const score_t eps = get_threshold(omega, _k);
 
     // generate all k-mers
     for (size_t i = 0; i < sigma; ++i)
@@ -34,7 +34,7 @@ bb_return brute_force::bf(size_t i, size_t j, code_t prefix, score_t score, scor
 {
     // score = score + _matrix[i][j];
     score = score * _window.get(i, j);
-    prefix = (prefix << 2) | i;
+    prefix = (prefix << bit_length) | i;
 
     if (j == _k - 1)
     {
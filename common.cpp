@@ -1,7 +1,61 @@
 #include <cmath>
+#include <stdexcept>
 #include "common.h"
 
 
+std::string to_string(algorithm alg)
+{
+    switch (alg)
+    {
+        case algorithm::bb:
+            return "bb";
+        case algorithm::dc:
+            return "dc";
+        case algorithm::dccw:
+            return "dccw";
+        case algorithm::rappas:
+            return "rappas";
+        case algorithm::baseline:
+            return "bl";
+        case algorithm::bbe:
+            return "bbe";
+        case algorithm::sbb:
+            return "sbb";
+        case algorithm::hybrid:
+            return "hybrid";
+        case algorithm::autotune:
+            return "auto";
+        case algorithm::topn:
+            return "topn";
+        case algorithm::lazy:
+            return "lazy";
+        case algorithm::multi_omega:
+            return "bb_mo";
+        case algorithm::multi_k:
+            return "bb_mk";
+        case algorithm::count:
+            return "count";
+        case algorithm::dense:
+            return "dense";
+    }
+    throw std::runtime_error("Unknown algorithm");
+}
+
+algorithm algorithm_from_string(const std::string& name)
+{
+    for (const auto alg : { algorithm::bb, algorithm::dc, algorithm::rappas, algorithm::dccw, algorithm::baseline,
+                            algorithm::bbe, algorithm::sbb, algorithm::hybrid, algorithm::autotune,
+                            algorithm::topn, algorithm::lazy, algorithm::multi_omega,
+                            algorithm::multi_k, algorithm::count, algorithm::dense })
+    {
+        if (to_string(alg) == name)
+        {
+            return alg;
+        }
+    }
+    throw std::runtime_error("Unknown algorithm: " + name);
+}
+
 bool kmer_score_comparator(const phylo_kmer& k1, const phylo_kmer& k2)
 {
     return k1.score > k2.score;
@@ -9,5 +63,18 @@ bool kmer_score_comparator(const phylo_kmer& k1, const phylo_kmer& k2)
 
 score_t get_threshold(score_t omega, size_t k)
 {
-    return std::pow((omega / 4), k);
+    return std::pow((omega / static_cast<score_t>(sigma)), k);
+}
+
+score_t shannon(const std::vector<score_t>& values)
+{
+    score_t result = 0.0;
+    for (const auto& v : values)
+    {
+        if (v > 0)
+        {
+            result += v * static_cast<score_t>(log2(v));
+        }
+    }
+    return - result;
 }
\ No newline at end of file
@@ -1,14 +1,59 @@
 #ifndef XPAS_ALGS_COMMON_H
 #define XPAS_ALGS_COMMON_H
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
 using score_t = float;
+
+/// The width of the k-mer codes is chosen at compile time with KMER_CODE_BITS, 64 by default.
+/// 32-bit codes halve the size of phylo_kmer for small k, 128-bit codes allow long k-mers
+#if KMER_CODE_BITS == 32
+using code_t = uint32_t;
+#elif KMER_CODE_BITS == 128
+using code_t = unsigned __int128;
+#else
 using code_t = uint64_t;
-using map_t = std::unordered_map<code_t, score_t>;
+#endif
+
+/// The code folded into 64 bits for hashing
+inline uint64_t fold(code_t code)
+{
+    // shifted in two steps to stay defined for the codes of 64 bits or less
+    const auto high = code >> (4 * sizeof(code_t)) >> (4 * sizeof(code_t));
+    return static_cast<uint64_t>(code) ^ (static_cast<uint64_t>(high) * 0x9e3779b97f4a7c15ULL);
+}
 
+/// std::hash is not defined for 128-bit integers in the strict standard mode
+struct code_hash
+{
+    size_t operator()(code_t code) const noexcept
+    {
+        return std::hash<uint64_t>()(fold(code));
+    }
+};
+
+using map_t = std::unordered_map<code_t, score_t, code_hash>;
+
+/// The alphabet is chosen at compile time: DNA by default, amino acids with SEQ_TYPE_AA.
+/// A character takes bit_length bits of a k-mer code
+#ifdef SEQ_TYPE_AA
+static const size_t sigma = 20;
+static const size_t bit_length = 5;
+#else
 static const size_t sigma = 4;
+static const size_t bit_length = 2;
+#endif
+
+/// With big alphabets, the engines go through the characters of a column from the best to the worst
+/// and stop at the first one that can not make a k-mer. With four characters, that is not worth sorting
+static const bool sorted_columns = sigma > 4;
+
+/// The longest k-mer a code can hold
+static const size_t max_k = 8 * sizeof(code_t) / bit_length;
 
 
 enum class bb_return
@@ -25,9 +70,45 @@ struct phylo_kmer
     score_t score;
 };
 
+enum class algorithm
+{
+    bb = 0,
+    dc = 1,
+    rappas = 2,
+    dccw = 3,
+    baseline = 4,
+    bbe = 5,
+    sbb = 6,
+    hybrid = 7,
+    autotune = 8,
+    topn = 9,
+    lazy = 10,
+    multi_omega = 11,
+    multi_k = 12,
+    count = 13,
+    dense = 14
+};
+
+struct run_stats
+{
+    algorithm alg;
+    size_t num_kmers;
+    unsigned long time;
+    size_t k;
+    score_t omega;
+    std::string node;
+    size_t window_pos;
+};
+
+std::string to_string(algorithm alg);
+
+algorithm algorithm_from_string(const std::string& name);
+
 bool kmer_score_comparator(const phylo_kmer& k1, const phylo_kmer& k2);
 
 score_t get_threshold(score_t omega, size_t k);
 
+score_t shannon(const std::vector<score_t>& values);
+
 
 #endif //XPAS_ALGS_COMMON_H
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "database.h"
+
+static const char db_magic[4] = { 'X', 'P', 'D', 'B' };
+static const uint32_t db_version = 2;
+
+/// Written as is, it tells the byte order of the file
+static const uint32_t byte_order_mark = 0x01020304;
+
+/// The offsets of the parts of the file are aligned to this
+static const size_t db_alignment = 64;
+
+static const size_t posting_size = posting_list::posting_size;
+
+struct db_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t code_size;
+    uint32_t byte_order;
+    uint64_t k;
+    float omega;
+    uint32_t bucket_bits;
+    uint64_t num_nodes;
+    uint64_t num_codes;
+    uint64_t num_postings;
+    uint64_t names_offset;
+    uint64_t buckets_offset;
+    uint64_t directory_offset;
+    uint64_t postings_offset;
+    uint64_t file_size;
+
+    // the lower end of the quantized log-scores, finite even when the threshold is 0
+    double log_threshold;
+};
+
+static_assert(std::is_trivially_copyable_v<db_header>, "The header is written as is");
+
+static size_t align(size_t offset)
+{
+    return (offset + db_alignment - 1) / db_alignment * db_alignment;
+}
+
+/// The number of significant bits of the codes of k-mers
+static size_t get_code_bits(size_t k)
+{
+    return std::min(k * bit_length, 8 * sizeof(code_t));
+}
+
+/// The smallest b such that 2^b >= n
+static size_t ceil_log2(size_t n)
+{
+    size_t b = 0;
+    while ((size_t{ 1 } << b) < n)
+    {
+        ++b;
+    }
+    return b;
+}
+
+static size_t get_bucket(code_t kmer, size_t code_bits, size_t bucket_bits)
+{
+    return bucket_bits == 0 ? 0 : static_cast<size_t>(kmer >> (code_bits - bucket_bits));
+}
+
+/// Appends an entry to the directory. The entries are written as is, the padding after 32-bit codes is zeroed
+/// for the files to be reproducible
+static void add_entry(std::vector<db_directory_entry>& directory, code_t kmer, uint64_t begin)
+{
+    auto& entry = directory.emplace_back();
+    std::memset(&entry, 0, sizeof(entry));
+    entry.kmer = kmer;
+    entry.begin = begin;
+}
+
+db_builder::db_builder(size_t k, score_t omega)
+    : _k(k), _omega(omega)
+{}
+
+void db_builder::add(const std::string& node, const std::vector<phylo_kmer>& kmers)
+{
+    const auto [it, inserted] = _node_ids.try_emplace(node, static_cast<uint32_t>(_nodes.size()));
+    if (inserted)
+    {
+        if (_nodes.size() == UINT32_MAX)
+        {
+            throw std::runtime_error("Too many nodes for the database");
+        }
+        _nodes.push_back(node);
+    }
+
+    const auto id = it->second;
+    _entries.reserve(_entries.size() + kmers.size());
+    for (const auto& [kmer, score] : kmers)
+    {
+        _entries.push_back({ kmer, id, score });
+    }
+}
+
+void db_builder::add(kmer_reader& reader)
+{
+    for (size_t i = 0; i < reader.sections().size(); ++i)
+    {
+        const auto& section = reader.sections()[i];
+        if (section.k == _k && section.omega == _omega)
+        {
+            add(section.node, reader.read(i));
+        }
+    }
+}
+
+void db_builder::write(const std::string& filename)
+{
+    std::sort(_entries.begin(), _entries.end(), [](const entry& a, const entry& b) {
+        return a.kmer < b.kmer || (a.kmer == b.kmer && a.node < b.node);
+    });
+
+    // The same k-mer and node from different sections
+    size_t num_postings = 0;
+    for (size_t i = 0; i < _entries.size(); ++i)
+    {
+        if (num_postings > 0 && _entries[num_postings - 1].kmer == _entries[i].kmer
+            && _entries[num_postings - 1].node == _entries[i].node)
+        {
+            auto& best = _entries[num_postings - 1].score;
+            best = std::max(best, _entries[i].score);
+        }
+        else
+        {
+            _entries[num_postings++] = _entries[i];
+        }
+    }
+    _entries.resize(num_postings);
+
+    std::vector<db_directory_entry> directory;
+    for (size_t i = 0; i < _entries.size(); ++i)
+    {
+        if (i == 0 || _entries[i].kmer != _entries[i - 1].kmer)
+        {
+            add_entry(directory, _entries[i].kmer, i);
+        }
+    }
+    const auto num_codes = directory.size();
+    add_entry(directory, ~code_t{ 0 }, num_postings);
+
+    // About one code per bucket
+    const auto code_bits = get_code_bits(_k);
+    const auto bucket_bits = std::min({ ceil_log2(num_codes), code_bits, size_t{ 32 } });
+    const auto num_buckets = size_t{ 1 } << bucket_bits;
+    std::vector<uint64_t> buckets(num_buckets + 1, num_codes);
+    for (size_t i = num_codes; i-- > 0;)
+    {
+        buckets[get_bucket(directory[i].kmer, code_bits, bucket_bits)] = i;
+    }
+    // The empty buckets start where the next one does
+    for (size_t b = num_buckets; b-- > 0;)
+    {
+        buckets[b] = std::min(buckets[b], buckets[b + 1]);
+    }
+
+    std::string names;
+    for (const auto& node : _nodes)
+    {
+        const auto size = static_cast<uint32_t>(node.size());
+        names.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        names += node;
+    }
+
+    const auto log_threshold = get_log_threshold(_omega, _k);
+    std::string postings(num_postings * posting_size, '\0');
+    for (size_t i = 0; i < num_postings; ++i)
+    {
+        const auto score = quantize(_entries[i].score, log_threshold);
+        std::memcpy(&postings[i * posting_size], &_entries[i].node, sizeof(uint32_t));
+        std::memcpy(&postings[i * posting_size + sizeof(uint32_t)], &score, sizeof(uint16_t));
+    }
+
+    db_header header{};
+    std::memcpy(header.magic, db_magic, sizeof(db_magic));
+    header.version = db_version;
+    header.code_size = sizeof(code_t);
+    header.byte_order = byte_order_mark;
+    header.k = _k;
+    header.omega = _omega;
+    header.bucket_bits = static_cast<uint32_t>(bucket_bits);
+    header.num_nodes = _nodes.size();
+    header.num_codes = num_codes;
+    header.num_postings = num_postings;
+    header.names_offset = align(sizeof(header));
+    header.buckets_offset = align(header.names_offset + names.size());
+    header.directory_offset = align(header.buckets_offset + buckets.size() * sizeof(uint64_t));
+    header.postings_offset = align(header.directory_offset + directory.size() * sizeof(directory.front()));
+    header.file_size = header.postings_offset + postings.size();
+    header.log_threshold = log_threshold;
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open " + filename);
+    }
+
+    size_t position = 0;
+    const auto put = [&file, &position](uint64_t offset, const void* data, size_t size) {
+        const std::string padding(offset - position, '\0');
+        file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        position = offset + size;
+    };
+    put(0, &header, sizeof(header));
+    put(header.names_offset, names.data(), names.size());
+    put(header.buckets_offset, buckets.data(), buckets.size() * sizeof(uint64_t));
+    put(header.directory_offset, directory.data(), directory.size() * sizeof(directory.front()));
+    put(header.postings_offset, postings.data(), postings.size());
+    if (!file)
+    {
+        throw std::runtime_error("Could not write the database " + filename);
+    }
+}
+
+kmer_database::kmer_database(const std::string& filename)
+    : _data(nullptr), _size(0), _mapped(false)
+{
+#ifdef __linux__
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Could not open " + filename);
+    }
+    _size = static_cast<size_t>(info.st_size);
+    if (_size > 0)
+    {
+        void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            throw std::runtime_error("Could not map " + filename);
+        }
+        // lookups jump all over the file, read-ahead would only waste the page cache
+        madvise(data, _size, MADV_RANDOM);
+        _data = static_cast<const char*>(data);
+        _mapped = true;
+    }
+    else
+    {
+        ::close(fd);
+    }
+#else
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    _buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    _data = _buffer.data();
+    _size = _buffer.size();
+#endif
+
+    try
+    {
+        db_header header{};
+        if (_size < sizeof(header))
+        {
+            throw std::runtime_error("Not a k-mer database: " + filename);
+        }
+        std::memcpy(&header, _data, sizeof(header));
+        if (std::memcmp(header.magic, db_magic, sizeof(db_magic)) != 0 || header.version != db_version)
+        {
+            throw std::runtime_error("Not a k-mer database of a supported version: " + filename);
+        }
+        if (header.code_size != sizeof(code_t) || header.byte_order != byte_order_mark)
+        {
+            throw std::runtime_error("The k-mer database " + filename + " was built for another width of codes "
+                                     "or byte order");
+        }
+        if (header.file_size != _size || header.names_offset > header.buckets_offset
+            || header.buckets_offset > header.directory_offset || header.directory_offset > header.postings_offset
+            || header.postings_offset > _size || header.num_postings > (_size - header.postings_offset) / posting_size
+            || header.k == 0 || header.k > max_k
+            || header.bucket_bits > get_code_bits(header.k) || header.bucket_bits > 32
+            || !std::isfinite(header.log_threshold) || header.log_threshold >= 0.0)
+        {
+            throw std::runtime_error("Corrupted k-mer database: " + filename);
+        }
+
+        // The bucket table and the directory with its sentinel fit before the next table
+        const auto num_buckets = (uint64_t{ 1 } << header.bucket_bits) + 1;
+        if ((header.directory_offset - header.buckets_offset) / sizeof(uint64_t) < num_buckets
+            || (header.postings_offset - header.directory_offset) / sizeof(db_directory_entry) <= header.num_codes)
+        {
+            throw std::runtime_error("Corrupted k-mer database: " + filename);
+        }
+
+        _k = header.k;
+        _omega = header.omega;
+        _log_threshold = header.log_threshold;
+        _num_codes = header.num_codes;
+        _bucket_bits = header.bucket_bits;
+        _code_bits = get_code_bits(_k);
+        _buckets = reinterpret_cast<const uint64_t*>(_data + header.buckets_offset);
+        _directory = reinterpret_cast<const db_directory_entry*>(_data + header.directory_offset);
+        _postings = _data + header.postings_offset;
+
+        // The buckets index the directory and the directory indexes the postings, both in order.
+        // This reads the two tables once, so that find never goes past the end of the file
+        for (size_t b = 0; b < num_buckets; ++b)
+        {
+            if (_buckets[b] > _num_codes || (b > 0 && _buckets[b] < _buckets[b - 1]))
+            {
+                throw std::runtime_error("Corrupted k-mer database: " + filename);
+            }
+        }
+        for (size_t i = 0; i <= _num_codes; ++i)
+        {
+            if (_directory[i].begin > header.num_postings || (i > 0 && _directory[i].begin < _directory[i - 1].begin))
+            {
+                throw std::runtime_error("Corrupted k-mer database: " + filename);
+            }
+        }
+
+        const auto* names = _data + header.names_offset;
+        for (size_t i = 0; i < header.num_nodes; ++i)
+        {
+            uint32_t size;
+            if (names + sizeof(size) > _data + header.buckets_offset)
+            {
+                throw std::runtime_error("Corrupted k-mer database: " + filename);
+            }
+            std::memcpy(&size, names, sizeof(size));
+            names += sizeof(size);
+            if (size > static_cast<size_t>(_data + header.buckets_offset - names))
+            {
+                throw std::runtime_error("Corrupted k-mer database: " + filename);
+            }
+            _names.emplace_back(names, size);
+            names += size;
+        }
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+kmer_database::~kmer_database() noexcept
+{
+    release();
+}
+
+size_t kmer_database::get_k() const
+{
+    return _k;
+}
+
+score_t kmer_database::get_omega() const
+{
+    return _omega;
+}
+
+size_t kmer_database::num_codes() const
+{
+    return _num_codes;
+}
+
+size_t kmer_database::num_nodes() const
+{
+    return _names.size();
+}
+
+std::string_view kmer_database::node_name(uint32_t node) const
+{
+    return _names.at(node);
+}
+
+posting_list kmer_database::find(code_t kmer) const
+{
+    if (!fits(kmer))
+    {
+        return { nullptr, 0, _log_threshold };
+    }
+
+    const auto bucket = get_bucket(kmer, _code_bits, _bucket_bits);
+    const auto* first = _directory + _buckets[bucket];
+    const auto* last = _directory + _buckets[bucket + 1];
+
+    // A bucket holds about one code
+    for (const auto* it = first; it != last; ++it)
+    {
+        if (it->kmer == kmer)
+        {
+            return { _postings + it->begin * posting_size, static_cast<size_t>((it + 1)->begin - it->begin),
+                     _log_threshold };
+        }
+        if (it->kmer > kmer)
+        {
+            break;
+        }
+    }
+    return { nullptr, 0, _log_threshold };
+}
+
+const void* kmer_database::bucket_address(code_t kmer) const
+{
+    return fits(kmer) ? _buckets + get_bucket(kmer, _code_bits, _bucket_bits) : _buckets;
+}
+
+bool kmer_database::fits(code_t kmer) const
+{
+    return _code_bits >= 8 * sizeof(code_t) || (kmer >> _code_bits) == 0;
+}
+
+double kmer_database::get_log_threshold() const
+{
+    return _log_threshold;
+}
+
+void kmer_database::release() noexcept
+{
+#ifdef __linux__
+    if (_mapped)
+    {
+        munmap(const_cast<char*>(_data), _size);
+    }
+#endif
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
@@ -0,0 +1,190 @@
+#ifndef XPAS_ALGS_DATABASE_H
+#define XPAS_ALGS_DATABASE_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "kmer_io.h"
+
+/// A code of the directory and the index of its first posting. The postings of a code end where the ones
+/// of the next code begin, the directory ends with a sentinel entry
+struct db_directory_entry
+{
+    code_t kmer;
+    uint64_t begin;
+};
+
+/// The phylo-k-mer database: for every k-mer code, the nodes where it passes the threshold with their scores.
+///
+/// The file is laid out to be memory-mapped and used in place:
+///   - a fixed header;
+///   - the names of the nodes;
+///   - the bucket table: the codes are split into 2^b buckets by their b high bits,
+///     and the table has the index of the first directory entry of every bucket;
+///   - the directory: the codes sorted, each with the position of its posting list;
+///   - the postings: (node id, quantized score) pairs, sorted by node for every code.
+/// A bucket holds about one code, so a lookup reads the bucket table, one or two directory entries
+/// next to each other, and the postings. The file is host-endian, a build only reads the files
+/// with its own width of codes and byte order.
+class db_builder
+{
+public:
+    db_builder(size_t k, score_t omega);
+
+    /// Adds the k-mers of a node. A node can be added many times, e.g. per range of windows:
+    /// the k-mers found more than once keep the best score
+    void add(const std::string& node, const std::vector<phylo_kmer>& kmers);
+
+    /// Adds the sections of a k-mer file with the same k and omega
+    void add(kmer_reader& reader);
+
+    void write(const std::string& filename);
+
+private:
+    struct entry
+    {
+        code_t kmer;
+        uint32_t node;
+        score_t score;
+    };
+
+    size_t _k;
+    score_t _omega;
+
+    std::vector<std::string> _nodes;
+    std::unordered_map<std::string, uint32_t> _node_ids;
+    std::vector<entry> _entries;
+};
+
+/// A node where a k-mer passes the threshold, and its score there
+struct posting
+{
+    uint32_t node;
+    score_t score;
+};
+
+/// The postings of a code, pointing into the database
+class posting_list
+{
+public:
+    /// A posting is the node id (4 bytes) and the quantized score (2 bytes), unaligned
+    static constexpr size_t posting_size = 6;
+
+    posting_list(const char* data, size_t size, double log_threshold)
+        : _data(data), _size(size), _log_threshold(log_threshold)
+    {}
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    uint32_t node(size_t i) const
+    {
+        uint32_t node;
+        std::memcpy(&node, _data + i * posting_size, sizeof(node));
+        return node;
+    }
+
+    uint16_t quantized_score(size_t i) const
+    {
+        uint16_t score;
+        std::memcpy(&score, _data + i * posting_size + sizeof(uint32_t), sizeof(score));
+        return score;
+    }
+
+    score_t score(size_t i) const
+    {
+        return dequantize(quantized_score(i), _log_threshold);
+    }
+
+    /// The log of the score, without going through exp: the quantized scores are log-scores
+    double log_score(size_t i) const
+    {
+        return _log_threshold - _log_threshold * quantized_score(i) / 65535.0;
+    }
+
+    posting operator[](size_t i) const
+    {
+        return { node(i), score(i) };
+    }
+
+    /// The address of the postings, to prefetch them
+    const char* data() const
+    {
+        return _data;
+    }
+
+private:
+    const char* _data;
+    size_t _size;
+    double _log_threshold;
+};
+
+/// A read-only phylo-k-mer database. The file is memory-mapped (Linux) and shared
+/// through the page cache by all the processes that open it; nothing but the node names is loaded.
+/// Elsewhere, it is read into memory
+class kmer_database
+{
+public:
+    explicit kmer_database(const std::string& filename);
+    kmer_database(const kmer_database&) = delete;
+    kmer_database(kmer_database&&) = delete;
+    kmer_database& operator=(const kmer_database&) = delete;
+    kmer_database& operator=(kmer_database&&) = delete;
+    ~kmer_database() noexcept;
+
+    size_t get_k() const;
+
+    score_t get_omega() const;
+
+    size_t num_codes() const;
+
+    size_t num_nodes() const;
+
+    std::string_view node_name(uint32_t node) const;
+
+    /// The postings of a code, empty if it passes nowhere or is not a code of a k-mer
+    posting_list find(code_t kmer) const;
+
+    /// The address of the bucket of a code, to prefetch it before find.
+    /// The first bucket for the values that are not codes of k-mers
+    const void* bucket_address(code_t kmer) const;
+
+    /// The log of the threshold of the scores, the upper bound of the log-score of a k-mer
+    /// that is not in the database
+    double get_log_threshold() const;
+
+private:
+    void release() noexcept;
+
+    /// Whether the value has no bits over the ones of the codes of k-mers
+    bool fits(code_t kmer) const;
+
+    const char* _data;
+    size_t _size;
+    bool _mapped;
+    std::vector<char> _buffer;
+
+    size_t _k;
+    score_t _omega;
+    double _log_threshold;
+    size_t _num_codes;
+    size_t _bucket_bits;
+    size_t _code_bits;
+
+    std::vector<std::string_view> _names;
+    const uint64_t* _buckets;
+    const db_directory_entry* _directory;
+    const char* _postings;
+};
+
+#endif //XPAS_ALGS_DATABASE_H
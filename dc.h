@@ -5,16 +5,28 @@
 #include <cmath>
 #include "common.h"
 #include "matrix.h"
+#include "sink.h"
+#include "kmer_list.h"
 
 class dccw;
+class dc_count;
+
+/// The characters of the column j with the score > eps
+kmer_list as_column(const window& window, size_t j, score_t eps);
 
 class divide_and_conquer
 {
     friend class dccw;
+    friend class dc_count;
 public:
     divide_and_conquer(const window& window, size_t k, score_t omega);
     void run(score_t omega);
 
+    /// Passes the k-mers to the sink instead of storing them, get_result stays empty.
+    /// The halves of the window are still materialized
+    template<typename Sink>
+    void run(score_t omega, Sink& sink);
+
     const map_t& get_map();
 
     const std::vector<phylo_kmer>& get_result() const;
@@ -23,9 +35,14 @@ public:
 
     void preprocess();
 
-    std::vector<phylo_kmer> dc(score_t omega, size_t j, size_t h, score_t eps);
+    kmer_list dc(score_t omega, size_t j, size_t h, score_t eps);
 private:
 
+    /// Joins the m-mers of the left and the right halves of a range of h columns
+    /// into the ones with the score > eps. Sorts the smaller half
+    template<typename Sink>
+    void join(kmer_list& l, kmer_list& r, size_t h,
+              score_t eps_l, score_t eps_r, score_t eps, Sink& sink);
 
     score_t best_score(size_t j, size_t h);
 
@@ -33,9 +50,6 @@ private:
     size_t _k;
     size_t _prefix_size;
 
-    std::vector<phylo_kmer> _prefixes;
-    std::vector<phylo_kmer> _suffixes;
-
     std::vector<score_t> _best_scores;
 
     std::vector<phylo_kmer> _result_list;
@@ -44,22 +58,29 @@ private:
 class dccw
 {
 public:
-    dccw(const window& window, std::vector<phylo_kmer>& prefixes, size_t k, score_t lookbehind, score_t lookahead,
+    dccw(const window& window, kmer_list& prefixes, size_t k, score_t lookbehind, score_t lookahead,
          score_t omega);
     void run(score_t omega);
 
+    /// Passes the k-mers to the sink instead of storing them, get_result stays empty.
+    /// The prefixes and suffixes are still materialized, they are shared with the neighbor windows
+    template<typename Sink>
+    void run(score_t omega, Sink& sink);
+
     const map_t& get_map();
 
     const std::vector<phylo_kmer>& get_result() const;
 
     size_t get_num_kmers() const;
 
-    std::vector<phylo_kmer>&& get_suffixes();
+    kmer_list&& get_suffixes();
 
     score_t get_best_suffix_score() const;
 
 private:
-    std::vector<phylo_kmer> dc(score_t omega, size_t j, size_t h, score_t eps);
+    /// Computes the prefixes and the suffixes of the window and moves the ones alive in this window
+    /// to the front. Returns the numbers of alive prefixes and suffixes
+    std::pair<size_t, size_t> prepare(score_t omega, score_t eps, score_t eps_l, score_t eps_r);
 
     //void preprocess();
 
@@ -75,8 +96,8 @@ private:
     // The second score bound for prefixes: the best prefix score of the previous window
     score_t _lookbehind;
 
-    std::vector<phylo_kmer>& _prefixes;
-    std::vector<phylo_kmer> _suffixes;
+    kmer_list& _prefixes;
+    kmer_list _suffixes;
 
     //std::vector<score_t> _best_scores;
 
@@ -86,5 +107,182 @@ private:
     divide_and_conquer _dc;
 };
 
+/// Counts the k-mers of a window with the score > eps without enumerating them.
+/// The halves of the window are computed as in divide-and-conquer and sorted by score,
+/// then the pairs with the product > eps are counted with two pointers in O(n log n)
+class dc_count
+{
+public:
+    dc_count(const window& window, size_t k, score_t omega);
+    void run(score_t omega);
+
+    size_t get_num_kmers() const;
+
+private:
+    size_t _k;
+    divide_and_conquer _dc;
+    size_t _num_kmers;
+};
+
+template<typename Sink>
+void divide_and_conquer::run(score_t omega, Sink& sink)
+{
+    const auto eps = get_threshold(omega, _k);
+
+    if (_k == 1)
+    {
+        const auto column = as_column(_window, 0, eps);
+        for (size_t i = 0; i < column.size(); ++i)
+        {
+            sink.emit(column.code(i), column.score(i));
+        }
+        return;
+    }
+
+    score_t eps_l = eps / best_score(_k / 2, _k - _k / 2);
+    score_t eps_r = eps / best_score(0, _k / 2);
+
+    auto l = dc(omega, 0, _k / 2, eps_l);
+    auto r = dc(omega, _k / 2, _k - _k / 2, eps_r);
+    join(l, r, _k, eps_l, eps_r, eps, sink);
+}
+
+template<typename Sink>
+void divide_and_conquer::join(kmer_list& l, kmer_list& r, size_t h,
+                              score_t eps_l, score_t eps_r, score_t eps, Sink& sink)
+{
+    // let's sort not suffixes, but whichever is less to sort, suffixes or prefixes
+    bool prefix_sort = l.size() < r.size();
+    auto& min = prefix_sort ? l : r;
+    auto& max = prefix_sort ? r : l;
+
+    auto eps_min = prefix_sort ? eps_l : eps_r;
+    auto eps_max = prefix_sort ? eps_r : eps_l;
+
+    if (!min.empty())
+    {
+        min.sort_by_score();
+        const auto& min_scores = min.get_scores();
+        const auto& max_scores = max.get_scores();
+
+        //for (const auto& [a, a_score] : max)
+        //{
+        size_t i = 0;
+        while (i < max.size())
+        {
+            const auto a_score = max_scores[i];
+            if (a_score < eps_max)
+            {
+                break;
+            }
+            const auto a = max.code(i);
+
+            size_t i2 = 0;
+            while (i2 < min.size())
+            {
+                const auto b_score = min_scores[i2];
+                if (b_score < eps_min)
+                {
+                    break;
+                }
+            //for (const auto& [b, b_score] : min)
+            //{
+                //const auto score = prefix_score + suffix_score;
+                const auto score = a_score * b_score;
+                if (score <= eps)
+                {
+                    break;
+                }
+
+                const auto b = min.code(i2);
+                code_t kmer;
+                if (prefix_sort)
+                {
+                    kmer = (b << ((h - h / 2) * bit_length)) | a;
+                }
+                else
+                {
+                    kmer = (a << ((h - h / 2) * bit_length)) | b;
+                }
+                sink.emit(kmer, score);
+
+                i2++;
+            }
+            i++;
+        }
+    }
+}
+
+template<typename Sink>
+void dccw::run(score_t omega, Sink& sink)
+{
+    const auto eps = get_threshold(omega , _k);
+
+    score_t eps_r = eps / _window.range_product(0, _k / 2);
+    score_t eps_l = eps / _window.range_product(_k / 2, _k - _k / 2);
+
+    const auto [num_alive_prefixes, num_alive_suffixes] = prepare(omega, eps, eps_l, eps_r);
+    auto& L = _prefixes;
+    auto& R = _suffixes;
+
+    bool prefix_sort = num_alive_prefixes < num_alive_suffixes;
+    auto& min = prefix_sort ? L : R;
+    auto& max = prefix_sort ? R : L;
+
+    if (!min.empty())
+    {
+        auto eps_min = prefix_sort ? eps_l : eps_r;
+        auto eps_max = prefix_sort ? eps_r : eps_l;
+
+        min.sort_by_score(prefix_sort ? num_alive_prefixes : num_alive_suffixes);
+        const auto& min_scores = min.get_scores();
+        const auto& max_scores = max.get_scores();
+
+        //for (const auto& [a, a_score] : max)
+        size_t i = 0;
+        while (i < max.size())
+        {
+            const auto a_score = max_scores[i];
+            if (a_score < eps_max)
+            {
+                break;
+            }
+            const auto a = max.code(i);
+
+            //    for (const auto& [b, b_score] : min)
+            size_t j = 0;
+            while (j < min.size())
+            {
+                const auto b_score = min_scores[j];
+                if (b_score < eps_min)
+                {
+                    break;
+                }
+
+                const auto score = a_score * b_score;
+                if (score <= eps)
+                {
+                    break;
+                }
+
+                const auto b = min.code(j);
+                code_t kmer;
+                if (prefix_sort)
+                {
+                    kmer = (b << ((_k - _k / 2) * bit_length)) | a;
+                }
+                else
+                {
+                    kmer = (a << ((_k - _k / 2) * bit_length)) | b;
+                }
+                sink.emit(kmer, score);
+
+                j++;
+            }
+
+            i++;
+        }
+    }
+}
 
 #endif //XPAS_ALGS_DAC_H
@@ -0,0 +1,93 @@
+#include <stdexcept>
+#include "dense.h"
+
+dense_table::dense_table(size_t k)
+    : _k(k)
+{
+    if (k == 0 || k > max_dense_k)
+    {
+        throw std::runtime_error("Dense tables support k from 1 to " + std::to_string(max_dense_k));
+    }
+}
+
+size_t dense_table::add_max(const window& window, score_t omega)
+{
+    const auto eps = get_threshold(omega, _k);
+    expand(window);
+
+    if (_best.empty())
+    {
+        _best.assign(_prefixes.size() * sigma, 0.0f);
+    }
+
+    score_t column[sigma];
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        column[i] = window.get(i, _k - 1);
+    }
+
+    size_t num_kmers = 0;
+    for (size_t p = 0; p < _prefixes.size(); ++p)
+    {
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            const auto score = _prefixes[p] * column[i];
+            const bool passes = score > eps;
+            num_kmers += passes ? 1 : 0;
+
+            auto& best = _best[p * sigma + i];
+            best = std::max(best, passes ? score : 0.0f);
+        }
+    }
+    return num_kmers;
+}
+
+void dense_table::clear()
+{
+    std::fill(_best.begin(), _best.end(), 0.0f);
+}
+
+size_t dense_table::memory_size(size_t k)
+{
+    // The best scores, the products of the first k - 1 columns and of the first k - 2 for the expansion
+    size_t num_prefixes = 1;
+    for (size_t j = 0; j + 1 < k; ++j)
+    {
+        num_prefixes *= sigma;
+    }
+    return (num_prefixes * sigma + num_prefixes + num_prefixes / sigma) * sizeof(score_t);
+}
+
+size_t dense_table::get_k() const
+{
+    return _k;
+}
+
+void dense_table::expand(const window& window)
+{
+    /// The buffers alternate so that the products of k - 1 columns end up in _prefixes
+    auto* current = (_k % 2 == 1) ? &_prefixes : &_scratch;
+    auto* next = (_k % 2 == 1) ? &_scratch : &_prefixes;
+    current->assign(1, 1.0f);
+
+    for (size_t j = 0; j + 1 < _k; ++j)
+    {
+        score_t column[sigma];
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            column[i] = window.get(i, j);
+        }
+
+        next->resize(current->size() * sigma);
+        const auto* from = current->data();
+        auto* to = next->data();
+        for (size_t p = 0; p < current->size(); ++p)
+        {
+            for (size_t i = 0; i < sigma; ++i)
+            {
+                to[p * sigma + i] = from[p] * column[i];
+            }
+        }
+        std::swap(current, next);
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef XPAS_ALGS_DENSE_H
+#define XPAS_ALGS_DENSE_H
+
+#include <algorithm>
+#include <vector>
+#include "common.h"
+#include "matrix.h"
+
+/// The largest k with at most 2^24 k-mers
+constexpr size_t dense_limit(size_t k = 0, size_t size = 1)
+{
+    return size * sigma > (size_t{ 1 } << 24) ? k : dense_limit(k + 1, size * sigma);
+}
+
+/// The largest k of the dense tables, the scores take at most 64 MB: 12 for DNA, 5 for proteins
+static const size_t max_dense_k = dense_limit();
+
+/// The scores of all the sigma^k k-mers of windows in arrays indexed by the k-mer written in base sigma,
+/// which is the code for DNA.
+/// For small k or omega close to 0, most of the k-mers pass the threshold, and filling an array
+/// is much cheaper than enumerating the k-mers one by one and aggregating them.
+///
+/// The scores are a tensor product of the columns of the window, computed one column at a time
+/// from left to right like in branch-and-bound, so the scores are exactly the same. Every step is
+/// an outer product of the previous products with a column, which the compiler vectorizes
+class dense_table
+{
+public:
+    explicit dense_table(size_t k);
+
+    /// Passes the k-mers of the window with the score > eps to the sink in the order of codes
+    template<typename Sink>
+    void run(const window& window, score_t omega, Sink& sink);
+
+    /// Keeps the best score of every k-mer over the windows added, if it is > eps.
+    /// Returns the number of k-mers of the window with the score > eps
+    size_t add_max(const window& window, score_t omega);
+
+    /// Passes the k-mers with the best scores kept by add_max to the sink in the order of codes
+    template<typename Sink>
+    void emit_max(Sink& sink) const;
+
+    /// Forgets the best scores
+    void clear();
+
+    /// The memory of a table of k-mers of size k in bytes, once the best scores are allocated
+    static size_t memory_size(size_t k);
+
+    size_t get_k() const;
+
+private:
+    /// The code of the k-mer at the index of the table
+    code_t to_code(size_t index) const
+    {
+        if constexpr (sigma == size_t{ 1 } << bit_length)
+        {
+            return index;
+        }
+        else
+        {
+            code_t code = 0;
+            for (size_t j = 0; j < _k; ++j)
+            {
+                code |= static_cast<code_t>(index % sigma) << (j * bit_length);
+                index /= sigma;
+            }
+            return code;
+        }
+    }
+
+    /// Computes the products of the first k - 1 columns of the window into _prefixes
+    void expand(const window& window);
+
+    size_t _k;
+
+    std::vector<score_t> _prefixes;
+    std::vector<score_t> _scratch;
+
+    /// The best scores, allocated by the first add_max
+    std::vector<score_t> _best;
+};
+
+template<typename Sink>
+void dense_table::run(const window& window, score_t omega, Sink& sink)
+{
+    const auto eps = get_threshold(omega, _k);
+    expand(window);
+
+    score_t column[sigma];
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        column[i] = window.get(i, _k - 1);
+    }
+
+    for (size_t p = 0; p < _prefixes.size(); ++p)
+    {
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            const auto score = _prefixes[p] * column[i];
+            if (score > eps)
+            {
+                sink.emit(to_code(p * sigma + i), score);
+            }
+        }
+    }
+}
+
+template<typename Sink>
+void dense_table::emit_max(Sink& sink) const
+{
+    for (size_t index = 0; index < _best.size(); ++index)
+    {
+        if (_best[index] > 0.0f)
+        {
+            sink.emit(to_code(index), _best[index]);
+        }
+    }
+}
+
+#endif //XPAS_ALGS_DENSE_H
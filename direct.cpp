@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "direct.h"
+#include "encode.h"
+#include "estimate.h"
+#include "kmer_io.h"
+
+/// The number of reads in a task of the pool
+static const size_t reads_per_task = 16;
+
+/// The number of windows whose log-scores are summed at once, 1 KB of sums.
+/// The rows are padded so that every block is full and the loops have a constant trip count
+static const size_t window_block = 256;
+
+/// The costs of the cost model in nanoseconds: one addition of the direct sums,
+/// producing and merging a k-mer by branch-and-bound, and a lookup of a k-mer in the results.
+/// Measured with SSE2 for k from 6 to 10: 0.2 to 0.3 ns per addition, 25 to 130 ns per k-mer
+/// depending on how many k-mers are pruned, 33 ns per lookup in a kmer_database
+static const double direct_ns_per_add = 0.25;
+static const double enumerate_ns_per_kmer = 50.0;
+static const double lookup_ns_per_kmer = 35.0;
+
+/// The number of windows the output size is estimated on
+static const size_t num_sampled_windows = 32;
+
+direct_scorer::direct_scorer(const matrix& matrix, size_t k, score_t omega)
+    : direct_scorer(matrix, k, omega, get_log_threshold(omega, k))
+{}
+
+direct_scorer::direct_scorer(const matrix& matrix, size_t k, score_t omega, double penalty)
+    : _k(k), _num_windows(0), _width(0), _penalty(penalty)
+{
+    if (k == 0 || k > max_k)
+    {
+        throw std::runtime_error("Unsupported k for the direct scorer: " + std::to_string(k));
+    }
+
+    // The windows of to_windows, so that the scores are the ones of the engines: it leaves out the last position
+    _num_windows = to_windows::count(matrix, k);
+    _width = (_num_windows + window_block - 1) / window_block * window_block + k - 1;
+    _log_scores.assign(sigma * _width, 0.0f);
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        for (size_t j = 0; j < matrix.width(); ++j)
+        {
+            _log_scores[i * _width + j] = std::log(matrix.get(i, j));
+        }
+    }
+    _log_threshold = std::log(get_threshold(omega, k));
+}
+
+std::vector<double> direct_scorer::score(const std::vector<query>& batch, work_stealing_pool& pool)
+{
+    _workspaces.resize(pool.size());
+
+    std::vector<double> result(batch.size(), 0.0);
+    for (size_t begin = 0; begin < batch.size(); begin += reads_per_task)
+    {
+        const auto end = std::min(begin + reads_per_task, batch.size());
+        pool.submit([this, &batch, &result, begin, end](size_t worker) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                result[i] = score(batch[i].sequence, _workspaces[worker]);
+            }
+        });
+    }
+    pool.run();
+    return result;
+}
+
+double direct_scorer::score(const std::string& sequence)
+{
+    _workspaces.resize(std::max(_workspaces.size(), size_t{ 1 }));
+    return score(sequence, _workspaces[0]);
+}
+
+std::optional<score_t> direct_scorer::log_score(code_t kmer)
+{
+    _workspaces.resize(std::max(_workspaces.size(), size_t{ 1 }));
+    const auto log_score = best_log_score(kmer, _workspaces[0]);
+    if (log_score > _log_threshold)
+    {
+        return log_score;
+    }
+    return std::nullopt;
+}
+
+double direct_scorer::score(const std::string& sequence, workspace& space) const
+{
+    encode_kmers(sequence, _k, space.codes, space.valid);
+
+    double result = 0.0;
+    for (size_t i = 0; i < space.codes.size(); ++i)
+    {
+        if (space.valid[i])
+        {
+            const auto log_score = best_log_score(space.codes[i], space);
+            result += (log_score > _log_threshold) ? static_cast<double>(log_score) : _penalty;
+        }
+    }
+    return result;
+}
+
+/// Adds a slice of a row to the sums of a block of windows
+static void add_block(score_t* __restrict sums, const score_t* __restrict row)
+{
+    for (size_t j = 0; j < window_block; ++j)
+    {
+        sums[j] += row[j];
+    }
+}
+
+score_t direct_scorer::best_log_score(code_t kmer, workspace& space) const
+{
+    space.symbols.resize(_k);
+    space.sums.resize(window_block);
+    const code_t symbol_mask = (code_t{ 1 } << bit_length) - 1;
+    for (size_t t = _k; t-- > 0;)
+    {
+        space.symbols[t] = static_cast<uint8_t>(kmer & symbol_mask);
+        kmer >>= bit_length;
+    }
+
+    auto best = -std::numeric_limits<score_t>::infinity();
+    auto* sums = space.sums.data();
+    for (size_t begin = 0; begin < _num_windows; begin += window_block)
+    {
+        // The character t of the k-mer in the window j is at the column j + t
+        const auto* first = _log_scores.data() + space.symbols[0] * _width + begin;
+        std::copy(first, first + window_block, sums);
+        for (size_t t = 1; t < _k; ++t)
+        {
+            add_block(sums, _log_scores.data() + space.symbols[t] * _width + begin + t);
+        }
+
+        // The sums past the last window come from the padding
+        const auto size = std::min(window_block, _num_windows - begin);
+        best = std::max(best, *std::max_element(sums, sums + size));
+    }
+    return best;
+}
+
+bool direct_is_cheaper(size_t num_kmers, matrix& matrix, size_t k, score_t omega)
+{
+    if (matrix.width() < k)
+    {
+        return true;
+    }
+    const auto num_windows = to_windows::count(matrix, k);
+    const auto num_blocks = (num_windows + window_block - 1) / window_block;
+    const auto direct_cost = static_cast<double>(num_kmers) * static_cast<double>(k * num_blocks * window_block)
+        * direct_ns_per_add;
+
+    // The output size of evenly spread windows, scaled to all of them
+    const size_estimator estimator;
+    const auto step = std::max(num_windows / num_sampled_windows, size_t{ 1 });
+    double num_sampled = 0.0;
+    double sampled_size = 0.0;
+    for (size_t j = 0; j < num_windows; j += step)
+    {
+        sampled_size += estimator.estimate(window(matrix, j, k), k, omega).estimate;
+        num_sampled += 1.0;
+    }
+    const auto enumerate_cost = sampled_size / num_sampled * static_cast<double>(num_windows) * enumerate_ns_per_kmer
+        + static_cast<double>(num_kmers) * lookup_ns_per_kmer;
+
+    return direct_cost < enumerate_cost;
+}
@@ -0,0 +1,77 @@
+#ifndef XPAS_ALGS_DIRECT_H
+#define XPAS_ALGS_DIRECT_H
+
+#include <optional>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "matrix.h"
+#include "place.h"
+#include "pool.h"
+
+/// Scores reads against the matrix of one node without computing its phylo-k-mers.
+///
+/// The score of a k-mer at a node is its best score over the windows of the matrix, if it passes
+/// the threshold of omega, like in the output of the engines. Here it is computed for the k-mers of the reads only:
+/// the log-scores of the matrix are laid out by character, so the log-scores of a k-mer in consecutive windows
+/// are k sums of contiguous slices of the rows, which the compiler vectorizes. The windows are taken in blocks
+/// that fit in the L1 cache.
+///
+/// The score of a read is the same as the one of placement_scorer for this node: the sum of the log-scores
+/// of its valid k-mers, with the penalty for the k-mers that do not pass the threshold.
+/// A read costs O(k * (width - k)) per k-mer, which is worth it only for a few reads, see direct_is_cheaper
+class direct_scorer
+{
+public:
+    direct_scorer(const matrix& matrix, size_t k, score_t omega);
+    direct_scorer(const matrix& matrix, size_t k, score_t omega, double penalty);
+
+    /// The scores of the reads, in the order of the batch. The reads are split between the workers of the pool
+    std::vector<double> score(const std::vector<query>& batch, work_stealing_pool& pool);
+
+    /// The score of a read. Reads with no valid k-mer score 0
+    double score(const std::string& sequence);
+
+    /// The log of the best score of the k-mer over the windows, if it passes the threshold
+    std::optional<score_t> log_score(code_t kmer);
+
+private:
+    /// The buffers of a thread, reused across reads
+    struct workspace
+    {
+        std::vector<code_t> codes;
+        std::vector<uint8_t> valid;
+
+        /// The characters of the current k-mer and its log-scores in a block of windows
+        std::vector<uint8_t> symbols;
+        std::vector<score_t> sums;
+    };
+
+    double score(const std::string& sequence, workspace& space) const;
+
+    /// The best log-score of the k-mer over the windows, -inf if there are none
+    score_t best_log_score(code_t kmer, workspace& space) const;
+
+    size_t _k;
+    size_t _num_windows;
+
+    /// The log-scores of the matrix: the row of the character i starts at i * width
+    std::vector<score_t> _log_scores;
+    size_t _width;
+
+    score_t _log_threshold;
+    double _penalty;
+
+    std::vector<workspace> _workspaces;
+};
+
+/// Whether scoring num_kmers query k-mers with direct_scorer is expected to be faster than
+/// enumerating the phylo-k-mers of the matrix and looking them up.
+///
+/// Scoring directly costs num_kmers * k * num_windows additions. Enumerating costs the number of k-mers
+/// of the windows over the threshold, estimated with size_estimator on a sample of windows, times the cost
+/// of producing and merging one k-mer, plus one lookup per query k-mer. The costs per step were measured
+/// on branch-and-bound and the vectorized sums, they only have to be right within a factor of a few
+bool direct_is_cheaper(size_t num_kmers, matrix& matrix, size_t k, score_t omega);
+
+#endif //XPAS_ALGS_DIRECT_H
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <array>
+
+#if defined(__SSE2__) && !defined(SEQ_TYPE_AA)
+#include <emmintrin.h>
+#define XPAS_ALGS_SIMD_ENCODE
+#endif
+
+#include "encode.h"
+
+/// The characters in the order of the columns of the matrices
+#ifdef SEQ_TYPE_AA
+static const char alphabet[] = "ARNDCQEGHILKMFPSTWYV";
+#else
+static const char alphabet[] = "ACGT";
+#endif
+
+static_assert(sizeof(alphabet) == sigma + 1, "The alphabet does not match sigma");
+
+static std::array<uint8_t, 256> make_symbol_table()
+{
+    std::array<uint8_t, 256> table{};
+    table.fill(invalid_symbol);
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        const auto upper = static_cast<unsigned char>(alphabet[i]);
+        table[upper] = static_cast<uint8_t>(i);
+        table[upper - 'A' + 'a'] = static_cast<uint8_t>(i);
+    }
+#ifndef SEQ_TYPE_AA
+    table['U'] = table['T'];
+    table['u'] = table['T'];
+#endif
+    return table;
+}
+
+static const std::array<uint8_t, 256> symbol_table = make_symbol_table();
+
+/// The bits of a character in a code
+static const code_t symbol_mask = (code_t{ 1 } << bit_length) - 1;
+
+uint8_t encode_char(char c)
+{
+    return symbol_table[static_cast<unsigned char>(c)];
+}
+
+/// Maps the characters to their symbols, invalid_symbol for the ones out of the alphabet
+static void to_symbols(std::string_view sequence, uint8_t* symbols)
+{
+    size_t i = 0;
+#if defined(XPAS_ALGS_SIMD_ENCODE)
+    // For A, C, G, T and U in both cases, ((c >> 1) & 3) ^ ((c >> 2) & 1) is 0, 1, 2, 3 and 3,
+    // so the symbols are computed with shifts and masks, 16 characters at a time.
+    // The characters are valid if their upper case is one of the five
+    const auto case_mask = _mm_set1_epi8(static_cast<char>(0xDF));
+    const auto three = _mm_set1_epi8(3);
+    const auto one = _mm_set1_epi8(1);
+    const auto invalid = _mm_set1_epi8(static_cast<char>(invalid_symbol));
+    for (; i + 16 <= sequence.size(); i += 16)
+    {
+        const auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sequence.data() + i));
+
+        // There are no 8-bit shifts in SSE2, the bits that come from the next byte are masked out
+        const auto symbol = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(c, 1), three),
+                                          _mm_and_si128(_mm_srli_epi16(c, 2), one));
+
+        const auto upper = _mm_and_si128(c, case_mask);
+        const auto valid = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('A')), _mm_cmpeq_epi8(upper, _mm_set1_epi8('C'))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('G')),
+                                      _mm_cmpeq_epi8(upper, _mm_set1_epi8('T'))),
+                         _mm_cmpeq_epi8(upper, _mm_set1_epi8('U'))));
+
+        const auto result = _mm_or_si128(_mm_and_si128(valid, symbol), _mm_andnot_si128(valid, invalid));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(symbols + i), result);
+    }
+#endif
+    for (; i < sequence.size(); ++i)
+    {
+        symbols[i] = encode_char(sequence[i]);
+    }
+}
+
+/// The codes and the valid flags of the k-mers from the symbols, one k-mer after the other.
+/// valid can be the buffer of the symbols: the flag of the k-mer at p is written after the symbol at p + k - 1 is read
+static void roll_kmers(const uint8_t* symbols, size_t k, size_t num_kmers, code_t* codes, uint8_t* valid)
+{
+    // The characters older than k fall off the top of the code
+    const code_t mask = (k * bit_length >= 8 * sizeof(code_t))
+        ? ~code_t{ 0 }
+        : (code_t{ 1 } << (k * bit_length)) - 1;
+
+    // The position after the last invalid character so far
+    size_t valid_from = 0;
+    code_t code = 0;
+    for (size_t i = 0; i + 1 < k; ++i)
+    {
+        const auto symbol = symbols[i];
+        valid_from = (symbol == invalid_symbol) ? i + 1 : valid_from;
+        code = (code << bit_length) | (symbol & symbol_mask);
+    }
+
+    for (size_t p = 0; p < num_kmers; ++p)
+    {
+        const auto i = p + k - 1;
+        const auto symbol = symbols[i];
+        valid_from = (symbol == invalid_symbol) ? i + 1 : valid_from;
+        code = ((code << bit_length) | (symbol & symbol_mask)) & mask;
+        codes[p] = code;
+        valid[p] = (p >= valid_from) ? 1 : 0;
+    }
+}
+
+#if defined(XPAS_ALGS_SIMD_ENCODE)
+/// The number of k-mers encoded at once by roll_block, their intermediate codes stay on the stack
+static const size_t roll_block_size = 128;
+
+/// The number of zero symbols after the sequence that roll_block may read
+static const size_t symbol_padding = 80;
+
+/// The codes and the valid flags of up to roll_block_size k-mers, 16 at a time, for codes of at most 64 bits.
+///
+/// The code of a k-mer is the top k characters of the code of the 16 (32-bit codes) or 32 (64-bit codes)
+/// characters from its position, which is built by doubling: c4[p] has the symbols p to p + 3 in a byte,
+/// c8[p] = c4[p] << 8 | c4[p + 4] in 16 bits, c16[p] = c8[p] << 16 | c8[p + 8], and so on, by interleaving the lanes.
+/// The valid symbols are at most 3 and the invalid ones are 0xFF, so a k-mer is valid if the OR of its symbols is.
+/// For k >= 8 it is the OR of a few overlapping ORs of 8 symbols, computed once per position.
+///
+/// Only the symbols and their ORs are loaded at unaligned offsets: a load that straddles two recent stores can not be
+/// forwarded from them and stalls, so the intermediate codes are only loaded whole, and the ORs a loop after their stores.
+/// The symbols are read up to symbol_padding past the last k-mer. valid can be the buffer of the symbols
+static void roll_block(const uint8_t* symbols, size_t k, size_t num_kmers, code_t* codes, uint8_t* valid)
+{
+    alignas(16) uint16_t c8[roll_block_size + 32];
+    alignas(16) uint32_t c16[roll_block_size + 16];
+    alignas(16) uint8_t or8[roll_block_size + 32];
+
+    const auto load = [](const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); };
+    const auto store = [](void* p, __m128i v) { _mm_storeu_si128(static_cast<__m128i*>(p), v); };
+
+    // Rounded up, the codes and the flags past the last k-mer are written too
+    const auto count = (num_kmers + 15) / 16 * 16;
+
+    // The symbols are at most 3 after the mask, so the 16-bit shifts do not carry between the bytes
+    const auto three = _mm_set1_epi8(3);
+    const auto pack4 = [&three](__m128i s0, __m128i s1, __m128i s2, __m128i s3) {
+        return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_and_si128(s0, three), 6),
+                                         _mm_slli_epi16(_mm_and_si128(s1, three), 4)),
+                            _mm_or_si128(_mm_slli_epi16(_mm_and_si128(s2, three), 2), _mm_and_si128(s3, three)));
+    };
+
+    // c8, and the OR of the symbols p to p + 7.
+    // The lanes are little-endian: the characters at p go to the high half
+    for (size_t p = 0; p < count + 32; p += 16)
+    {
+        __m128i s[8];
+        for (size_t i = 0; i < 8; ++i)
+        {
+            s[i] = load(symbols + p + i);
+        }
+        const auto high = pack4(s[0], s[1], s[2], s[3]);
+        const auto low = pack4(s[4], s[5], s[6], s[7]);
+        store(c8 + p, _mm_unpacklo_epi8(low, high));
+        store(c8 + p + 8, _mm_unpackhi_epi8(low, high));
+        store(or8 + p, _mm_or_si128(_mm_or_si128(_mm_or_si128(s[0], s[1]), _mm_or_si128(s[2], s[3])),
+                                    _mm_or_si128(_mm_or_si128(s[4], s[5]), _mm_or_si128(s[6], s[7]))));
+    }
+
+    for (size_t p = 0; p < count + 16; p += 8)
+    {
+        const auto high = load(c8 + p);
+        const auto low = load(c8 + p + 8);
+        store(c16 + p, _mm_unpacklo_epi16(low, high));
+        store(c16 + p + 4, _mm_unpackhi_epi16(low, high));
+    }
+
+    const auto shift = _mm_cvtsi32_si128(static_cast<int>(8 * sizeof(code_t) - k * bit_length));
+    for (size_t p = 0; p < count; p += 4)
+    {
+        if constexpr (sizeof(code_t) == 4)
+        {
+            store(codes + p, _mm_srl_epi32(load(c16 + p), shift));
+        }
+        else
+        {
+            const auto high = load(c16 + p);
+            const auto low = load(c16 + p + 16);
+            store(codes + p, _mm_srl_epi64(_mm_unpacklo_epi32(low, high), shift));
+            store(codes + p + 2, _mm_srl_epi64(_mm_unpackhi_epi32(low, high), shift));
+        }
+    }
+
+    // The OR of the symbols of the k-mer, from the ORs of 8 for k >= 8, the last two overlap
+    const auto not_symbol = _mm_set1_epi8(static_cast<char>(~3));
+    const auto one = _mm_set1_epi8(1);
+    const auto zero = _mm_setzero_si128();
+    for (size_t p = 0; p < count; p += 16)
+    {
+        __m128i any;
+        if (k >= 8)
+        {
+            any = load(or8 + p + k - 8);
+            for (size_t i = 0; i + 8 < k; i += 8)
+            {
+                any = _mm_or_si128(any, load(or8 + p + i));
+            }
+        }
+        else
+        {
+            any = load(symbols + p);
+            for (size_t i = 1; i < k; ++i)
+            {
+                any = _mm_or_si128(any, load(symbols + p + i));
+            }
+        }
+
+        // The symbols at p are not read again
+        store(valid + p, _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(any, not_symbol), zero), one));
+    }
+}
+#endif
+
+void encode_kmers(std::string_view sequence, size_t k, std::vector<code_t>& codes, std::vector<uint8_t>& valid)
+{
+    if (k == 0 || sequence.size() < k)
+    {
+        codes.clear();
+        valid.clear();
+        return;
+    }
+
+    // The symbols go to the valid flags first, which are written over them.
+    // The buffers are resized without clearing them first, not to fill again what a previous read left
+    const auto num_kmers = sequence.size() - k + 1;
+#if defined(XPAS_ALGS_SIMD_ENCODE)
+    if constexpr (sizeof(code_t) <= 8)
+    {
+        if (k <= max_k)
+        {
+            valid.resize(sequence.size() + symbol_padding);
+            to_symbols(sequence, valid.data());
+            std::fill(valid.begin() + static_cast<std::ptrdiff_t>(sequence.size()), valid.end(), 0);
+            codes.resize((num_kmers + 15) / 16 * 16);
+            for (size_t p = 0; p < num_kmers; p += roll_block_size)
+            {
+                roll_block(valid.data() + p, k, std::min(roll_block_size, num_kmers - p), codes.data() + p,
+                           valid.data() + p);
+            }
+            codes.resize(num_kmers);
+            valid.resize(num_kmers);
+            return;
+        }
+    }
+#endif
+    valid.resize(sequence.size());
+    to_symbols(sequence, valid.data());
+    codes.resize(num_kmers);
+    roll_kmers(valid.data(), k, num_kmers, codes.data(), valid.data());
+    valid.resize(num_kmers);
+}
+
+std::string decode_kmer(code_t kmer, size_t k)
+{
+    std::string result(k, ' ');
+    for (size_t i = k; i-- > 0;)
+    {
+        result[i] = alphabet[static_cast<size_t>(kmer & symbol_mask)];
+        kmer >>= bit_length;
+    }
+    return result;
+}
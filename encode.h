@@ -0,0 +1,26 @@
+#ifndef XPAS_ALGS_ENCODE_H
+#define XPAS_ALGS_ENCODE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common.h"
+
+/// Sequences to k-mer codes with the layout of the engines: a character is its index in the columns
+/// of the matrices (A, C, G, T for DNA, with U as T), and a k-mer is (prefix << bit_length) | character.
+/// Upper and lower case are the same, anything else (N, gaps, ambiguity codes) is invalid
+
+/// Marks a character out of the alphabet
+static const uint8_t invalid_symbol = 0xFF;
+
+/// The index of a character in the alphabet, or invalid_symbol
+uint8_t encode_char(char c);
+
+/// The code of every k-mer of the sequence: codes[i] is the code of sequence[i, i + k).
+/// valid[i] is 0 if the k-mer has an invalid character, its code is meaningless then
+void encode_kmers(std::string_view sequence, size_t k, std::vector<code_t>& codes, std::vector<uint8_t>& valid);
+
+/// The characters of a code
+std::string decode_kmer(code_t kmer, size_t k);
+
+#endif //XPAS_ALGS_ENCODE_H
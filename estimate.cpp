@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "estimate.h"
+
+size_estimator::size_estimator(size_t num_bins)
+    : _num_bins(num_bins)
+{
+    if (num_bins == 0)
+    {
+        throw std::runtime_error("The number of bins of the size estimator can not be zero");
+    }
+}
+
+size_estimate size_estimator::estimate(const window& window, size_t k, score_t omega) const
+{
+    const auto eps = get_threshold(omega, k);
+
+    // With eps = 0, a k-mer passes iff it has no zero score, which is exactly countable
+    if (eps <= 0.0f)
+    {
+        double count = 1.0;
+        for (size_t j = 0; j < k; ++j)
+        {
+            size_t nonzero = 0;
+            for (size_t i = 0; i < sigma; ++i)
+            {
+                nonzero += window.get(i, j) > 0.0f ? 1 : 0;
+            }
+            count *= static_cast<double>(nonzero);
+        }
+        return { count, count, count };
+    }
+
+    // The sums of at least num_bins fail, so the histograms are cut there
+    const auto width = -std::log(static_cast<double>(eps)) / static_cast<double>(_num_bins);
+    std::vector<double> histogram(_num_bins, 0.0);
+    std::vector<double> next(_num_bins, 0.0);
+    histogram[0] = 1.0;
+
+    for (size_t j = 0; j < k; ++j)
+    {
+        std::fill(next.begin(), next.end(), 0.0);
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            const auto score = window.get(i, j);
+            if (score <= eps)
+            {
+                continue;
+            }
+
+            const auto bin = static_cast<size_t>(std::max(-std::log(static_cast<double>(score)) / width, 0.0));
+            for (size_t s = 0; s + bin < _num_bins; ++s)
+            {
+                next[s + bin] += histogram[s];
+            }
+        }
+        std::swap(histogram, next);
+    }
+
+    size_estimate result = { 0.0, 0.0, 0.0 };
+    for (size_t s = 0; s < _num_bins; ++s)
+    {
+        result.upper += histogram[s];
+        if (s + k <= _num_bins)
+        {
+            result.lower += histogram[s];
+        }
+        if (2 * s + k < 2 * _num_bins)
+        {
+            result.estimate += histogram[s];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef XPAS_ALGS_ESTIMATE_H
+#define XPAS_ALGS_ESTIMATE_H
+
+#include "common.h"
+#include "matrix.h"
+
+/// The estimated number of k-mers of a window with the score > eps,
+/// and the bounds the exact number is guaranteed to be within
+struct size_estimate
+{
+    double estimate;
+    double lower;
+    double upper;
+};
+
+/// Estimates the output size of a window without running any algorithm.
+///
+/// The log-scores of every column are put into a histogram of bins of equal width between log(eps) and 0,
+/// and the k histograms are convolved. A k-mer whose bins sum up to s has -log(score) in
+/// [s * width, (s + k) * width), so the mass of the sums below num_bins - k surely passes the threshold,
+/// the mass of the sums of at least num_bins surely does not, and the rest is split assuming
+/// the log-scores are in the middle of their bins. The bounds tighten as num_bins / k grows.
+/// Runs in O(k * sigma * num_bins)
+class size_estimator
+{
+public:
+    explicit size_estimator(size_t num_bins = 256);
+
+    size_estimate estimate(const window& window, size_t k, score_t omega) const;
+
+private:
+    size_t _num_bins;
+};
+
+#endif //XPAS_ALGS_ESTIMATE_H
@@ -0,0 +1,123 @@
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include "hybrid.h"
+
+hybrid::hybrid(const window& window, size_t k)
+    : _window(window)
+    , _k(k)
+{
+    if (_window.empty())
+    {
+        throw std::runtime_error("The matrix is empty.");
+    }
+
+    if (_window.size() != k)
+    {
+        throw std::runtime_error("The size of the window is not k");
+    }
+
+    preprocess();
+}
+
+void hybrid::run(score_t omega)
+{
+    vector_sink sink(_result_list);
+    run(omega, sink);
+}
+
+size_t hybrid::num_alive(size_t column, size_t j, size_t h, score_t eps) const
+{
+    // The best score the other columns of the range can contribute
+    const auto best_others = _window.range_product(j, h) / _best_column[column];
+
+    size_t alive = 0;
+    for (size_t i = 0; i < sigma; ++i)
+    {
+        if (_window.get(i, column) * best_others > eps)
+        {
+            ++alive;
+        }
+    }
+    return alive;
+}
+
+score_t hybrid::estimate_size(size_t j, size_t h, score_t eps) const
+{
+    // An upper bound: every column is pruned independently
+    score_t size = 1.0f;
+    for (size_t c = j; c < j + h; ++c)
+    {
+        size *= static_cast<score_t>(num_alive(c, j, h, eps));
+    }
+    return size;
+}
+
+score_t hybrid::bb_cost(size_t j, size_t h, score_t eps) const
+{
+    // Every alive prefix of length d is extended with sigma characters
+    score_t nodes = 0.0f;
+    score_t level = 1.0f;
+    for (size_t c = j; c < j + h; ++c)
+    {
+        nodes += level * sigma;
+        level *= static_cast<score_t>(num_alive(c, j, h, eps));
+    }
+    return nodes;
+}
+
+score_t hybrid::dc_cost(size_t j, size_t h, score_t eps)
+{
+    const auto h_l = h / 2;
+    const auto h_r = h - h / 2;
+    const score_t eps_l = eps / _window.range_product(j + h_l, h_r);
+    const score_t eps_r = eps / _window.range_product(j, h_l);
+
+    const auto size_l = estimate_size(j, h_l, eps_l);
+    const auto size_r = estimate_size(j + h_l, h_r, eps_r);
+    const auto size_min = std::min(size_l, size_r);
+
+    // Enumerating the halves, sorting the smaller one and scanning both with the output
+    return cost(j, h_l, eps_l) + cost(j + h_l, h_r, eps_r)
+        + size_min * std::log2(size_min + 1.0f)
+        + std::max(size_l, size_r)
+        + estimate_size(j, h, eps);
+}
+
+score_t hybrid::cost(size_t j, size_t h, score_t eps)
+{
+    if (h == 1)
+    {
+        return sigma;
+    }
+
+    const auto id = j * (_k + 1) + h;
+    if (_plan[id] == strategy::unknown)
+    {
+        const auto bb = bb_cost(j, h, eps);
+        const auto dc = dc_cost(j, h, eps);
+        _plan[id] = (bb <= dc) ? strategy::bb : strategy::dc;
+        _cost[id] = std::min(bb, dc);
+    }
+    return _cost[id];
+}
+
+void hybrid::preprocess()
+{
+    _best_column.reserve(_k);
+    for (size_t j = 0; j < _k; ++j)
+    {
+        _best_column.push_back(_window.max_at(j).second);
+    }
+}
+
+const std::vector<phylo_kmer>& hybrid::get_result() const
+{
+    return _result_list;
+}
+
+size_t hybrid::get_num_kmers() const
+{
+    return _result_list.size();
+}
@@ -0,0 +1,240 @@
+#ifndef XPAS_ALGS_HYBRID_H
+#define XPAS_ALGS_HYBRID_H
+
+#include "common.h"
+#include "matrix.h"
+#include "kmer_list.h"
+#include "sink.h"
+
+/// Branch-and-bound and divide-and-conquer combined within one window.
+/// Every range of columns is either enumerated by branch-and-bound or split in halves
+/// that are joined with the sorted merge of divide-and-conquer, whichever is cheaper
+/// according to a cost model. If one half turns out to be tiny, the other one
+/// is not materialized: the m-mers of the tiny half are extended by branch-and-bound.
+///
+/// The scores of the halves are multiplied together, not column by column from the left as in branch-and-bound,
+/// so the k-mers within rounding of the threshold may differ from the ones of branch-and-bound.
+class hybrid
+{
+public:
+    hybrid(const window& window, size_t k);
+    void run(score_t omega);
+
+    /// Passes the k-mers to the sink instead of storing them, get_result stays empty
+    template<typename Sink>
+    void run(score_t omega, Sink& sink);
+
+    const std::vector<phylo_kmer>& get_result() const;
+
+    size_t get_num_kmers() const;
+
+private:
+    enum class strategy
+    {
+        unknown = 0,
+        bb = 1,
+        dc = 2
+    };
+
+    /// Halves of at most this size are extended by branch-and-bound instead of being joined
+    static constexpr size_t tiny_half = sigma;
+
+    void preprocess();
+
+    /// Enumerates the m-mers of the columns [j, j + h) with the score > eps into the sink
+    template<typename Sink>
+    void enumerate(size_t j, size_t h, score_t eps, Sink& result);
+
+    template<typename Sink>
+    void join(kmer_list& l, kmer_list& r, size_t h_r,
+              score_t eps, score_t eps_l, score_t eps_r, Sink& result);
+
+    /// Branch-and-bound over the columns [j, end), starting from the given prefix
+    template<typename Emit>
+    void bb(size_t i, size_t j, size_t end, code_t prefix, score_t score, score_t eps, Emit& emit);
+
+    /// The cost model: the estimated number of m-mers of the columns [j, j + h) with the score > eps,
+    /// and the estimated cost of enumerating them with branch-and-bound or by splitting the range
+    score_t estimate_size(size_t j, size_t h, score_t eps) const;
+    score_t bb_cost(size_t j, size_t h, score_t eps) const;
+    score_t dc_cost(size_t j, size_t h, score_t eps);
+    score_t cost(size_t j, size_t h, score_t eps);
+
+    size_t num_alive(size_t column, size_t j, size_t h, score_t eps) const;
+
+    const window& _window;
+    size_t _k;
+
+    std::vector<score_t> _best_column;
+
+    /// The cheapest strategy and its cost for every range of columns [j, j + h), indexed by j * (k + 1) + h
+    std::vector<strategy> _plan;
+    std::vector<score_t> _cost;
+
+    std::vector<phylo_kmer> _result_list;
+};
+
+template<typename Sink>
+void hybrid::run(score_t omega, Sink& sink)
+{
+    const auto eps = get_threshold(omega, _k);
+
+    // The threshold of a range of columns only depends on the range: eps divided by the best score
+    // of the columns outside of it. The cost model can therefore be evaluated once per range
+    _plan = std::vector<strategy>(_k * (_k + 1), strategy::unknown);
+    _cost = std::vector<score_t>(_k * (_k + 1), 0.0f);
+    cost(0, _k, eps);
+
+    enumerate(0, _k, eps, sink);
+}
+
+template<typename Sink>
+void hybrid::enumerate(size_t j, size_t h, score_t eps, Sink& result)
+{
+    if (h == 1 || _plan[j * (_k + 1) + h] == strategy::bb)
+    {
+        auto emit = [&result](code_t kmer, score_t score) { result.emit(kmer, score); };
+        for (size_t i = 0; i < sigma; ++i)
+        {
+            bb(i, j, j + h, 0, 1.0f, eps, emit);
+        }
+        return;
+    }
+
+    const auto h_l = h / 2;
+    const auto h_r = h - h / 2;
+    const auto shift = h_r * bit_length;
+    const score_t eps_l = eps / _window.range_product(j + h_l, h_r);
+    const score_t eps_r = eps / _window.range_product(j, h_l);
+
+    // Enumerate first the half that is expected to be smaller
+    const bool left_first = estimate_size(j, h_l, eps_l) <= estimate_size(j + h_l, h_r, eps_r);
+
+    kmer_list first;
+    if (left_first)
+    {
+        enumerate(j, h_l, eps_l, first);
+    }
+    else
+    {
+        enumerate(j + h_l, h_r, eps_r, first);
+    }
+
+    // The first half is tiny: extend its m-mers over the columns of the other one
+    if (first.size() <= tiny_half)
+    {
+        for (size_t m = 0; m < first.size(); ++m)
+        {
+            const auto code = first.code(m);
+            const auto score = first.score(m);
+            if (left_first)
+            {
+                auto emit = [&result](code_t kmer, score_t kmer_score) { result.emit(kmer, kmer_score); };
+                for (size_t i = 0; i < sigma; ++i)
+                {
+                    bb(i, j + h_l, j + h, code, score, eps, emit);
+                }
+            }
+            else
+            {
+                auto emit = [&result, suffix = code, shift](code_t prefix, score_t kmer_score) {
+                    result.emit((prefix << shift) | suffix, kmer_score);
+                };
+                for (size_t i = 0; i < sigma; ++i)
+                {
+                    bb(i, j, j + h_l, 0, score, eps, emit);
+                }
+            }
+        }
+        return;
+    }
+
+    kmer_list second;
+    if (left_first)
+    {
+        enumerate(j + h_l, h_r, eps_r, second);
+        join(first, second, h_r, eps, eps_l, eps_r, result);
+    }
+    else
+    {
+        enumerate(j, h_l, eps_l, second);
+        join(second, first, h_r, eps, eps_l, eps_r, result);
+    }
+}
+
+template<typename Sink>
+void hybrid::join(kmer_list& l, kmer_list& r, size_t h_r,
+                  score_t eps, score_t eps_l, score_t eps_r, Sink& result)
+{
+    // Sort whichever is less to sort, suffixes or prefixes
+    const bool prefix_sort = l.size() < r.size();
+    auto& min = prefix_sort ? l : r;
+    const auto& max = prefix_sort ? r : l;
+
+    const auto eps_min = prefix_sort ? eps_l : eps_r;
+    const auto eps_max = prefix_sort ? eps_r : eps_l;
+
+    if (min.empty())
+    {
+        return;
+    }
+
+    min.sort_by_score();
+    const auto& min_scores = min.get_scores();
+    const auto& max_scores = max.get_scores();
+
+    for (size_t i = 0; i < max.size(); ++i)
+    {
+        const auto a_score = max_scores[i];
+        if (a_score < eps_max)
+        {
+            continue;
+        }
+        const auto a = max.code(i);
+
+        for (size_t i2 = 0; i2 < min.size(); ++i2)
+        {
+            const auto b_score = min_scores[i2];
+            if (b_score < eps_min)
+            {
+                break;
+            }
+
+            const auto score = a_score * b_score;
+            if (score <= eps)
+            {
+                break;
+            }
+
+            const auto b = min.code(i2);
+            const code_t kmer = prefix_sort ? (b << (h_r * bit_length)) | a : (a << (h_r * bit_length)) | b;
+            result.emit(kmer, score);
+        }
+    }
+}
+
+template<typename Emit>
+void hybrid::bb(size_t i, size_t j, size_t end, code_t prefix, score_t score, score_t eps, Emit& emit)
+{
+    score = score * _window.get(i, j);
+    prefix = (prefix << bit_length) | i;
+
+    if (j == end - 1)
+    {
+        if (score > eps)
+        {
+            emit(prefix, score);
+        }
+        return;
+    }
+
+    if (score * _window.range_product(j + 1, end - (j + 1)) > eps)
+    {
+        for (size_t i2 = 0; i2 < sigma; ++i2)
+        {
+            bb(i2, j + 1, end, prefix, score, eps, emit);
+        }
+    }
+}
+
+#endif //XPAS_ALGS_HYBRID_H
@@ -0,0 +1,525 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "kmer_io.h"
+#include "radix.h"
+
+static const char magic[4] = { 'X', 'P', 'K', 'M' };
+static const uint32_t version = 3;
+
+/// The size of the header: the magic, the version and the size of a code in bytes
+static const size_t header_size = sizeof(magic) + 4 + 1;
+
+/// The size of the trailer: the offset of the directory and the magic
+static const size_t trailer_size = 8 + sizeof(magic);
+
+template<typename T>
+static void put_varint(std::string& out, T value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/// Little-endian, whatever the platform is
+template<typename T>
+static void put_fixed(std::string& out, T value, size_t num_bytes)
+{
+    for (size_t i = 0; i < num_bytes; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+static void put_float(std::string& out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_fixed(out, bits, sizeof(bits));
+}
+
+static void put_double(std::string& out, double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_fixed(out, bits, sizeof(bits));
+}
+
+static void put_string(std::string& out, const std::string& value)
+{
+    put_varint(out, value.size());
+    out += value;
+}
+
+/// Reads the values written by the put_ functions from a buffer
+class byte_reader
+{
+public:
+    byte_reader(const char* begin, const char* end)
+        : _current(begin), _end(end)
+    {}
+
+    template<typename T = uint64_t>
+    T varint()
+    {
+        T value = 0;
+        for (size_t shift = 0; shift < 8 * sizeof(T); shift += 7)
+        {
+            const auto byte = static_cast<uint8_t>(*require(1));
+            value |= static_cast<T>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        throw std::runtime_error("Corrupted k-mer file: bad varint");
+    }
+
+    template<typename T = uint64_t>
+    T fixed(size_t num_bytes)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(require(num_bytes));
+        T value = 0;
+        for (size_t i = 0; i < num_bytes; ++i)
+        {
+            value |= static_cast<T>(bytes[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    float real()
+    {
+        const auto bits = static_cast<uint32_t>(fixed(4));
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    double real64()
+    {
+        const auto bits = fixed(8);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    std::string string()
+    {
+        const auto size = varint();
+        const auto* bytes = require(size);
+        return { bytes, size };
+    }
+
+private:
+    const char* require(size_t num_bytes)
+    {
+        if (static_cast<size_t>(_end - _current) < num_bytes)
+        {
+            throw std::runtime_error("Corrupted k-mer file: unexpected end of data");
+        }
+        const auto* result = _current;
+        _current += num_bytes;
+        return result;
+    }
+
+    const char* _current;
+    const char* _end;
+};
+
+static std::string read_bytes(std::ifstream& file, uint64_t offset, size_t num_bytes)
+{
+    std::string buffer(num_bytes, '\0');
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(buffer.data(), static_cast<std::streamsize>(num_bytes));
+    if (!file)
+    {
+        throw std::runtime_error("Corrupted k-mer file: unexpected end of file");
+    }
+    return buffer;
+}
+
+double get_log_threshold(score_t omega, size_t k)
+{
+    // The threshold is 0 for omega = 0 or when it underflows, no stored score is below the smallest float then
+    static const auto log_floor = std::log(static_cast<double>(std::numeric_limits<score_t>::denorm_min()));
+    const auto log_threshold = std::log(static_cast<double>(get_threshold(omega, k)));
+    if (!(log_threshold < 0.0))
+    {
+        return -1.0;
+    }
+    return std::max(log_threshold, log_floor);
+}
+
+uint16_t quantize(score_t score, double log_threshold)
+{
+    const auto x = (std::log(static_cast<double>(score)) - log_threshold) / -log_threshold;
+    if (!(x > 0.0))
+    {
+        // Scores at or below the threshold, and NaN
+        return 0;
+    }
+    return static_cast<uint16_t>(std::lround(std::min(x, 1.0) * 65535.0));
+}
+
+score_t dequantize(uint16_t value, double log_threshold)
+{
+    return static_cast<score_t>(std::exp(log_threshold - log_threshold * value / 65535.0));
+}
+
+kmer_writer::kmer_writer(const std::string& filename, score_format format, size_t block_size)
+    : _file(filename, std::ios::binary)
+    , _format(format)
+    , _block_size(block_size)
+    , _in_section(false)
+    , _section{}
+    , _log_threshold(0.0)
+    , _last_code(0)
+    , _position(0)
+    , _closed(false)
+{
+    if (!_file)
+    {
+        throw std::runtime_error("Could not open " + filename);
+    }
+
+    if (_block_size == 0)
+    {
+        throw std::runtime_error("The block size must be positive");
+    }
+
+    std::string header(magic, sizeof(magic));
+    put_fixed(header, version, 4);
+    put_fixed(header, sizeof(code_t), 1);
+    _file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    _position += header.size();
+}
+
+kmer_writer::~kmer_writer() noexcept
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void kmer_writer::write(const std::string& node, size_t k, score_t omega, std::vector<phylo_kmer> kmers)
+{
+    if (_closed)
+    {
+        throw std::runtime_error("The k-mer file is closed");
+    }
+
+    radix_sort(kmers, k);
+    begin_section(node, k, omega);
+    for (const auto& [kmer, score] : kmers)
+    {
+        append(kmer, score);
+    }
+    end_section();
+}
+
+void kmer_writer::begin_section(const std::string& node, size_t k, score_t omega)
+{
+    if (_closed)
+    {
+        throw std::runtime_error("The k-mer file is closed");
+    }
+
+    if (_in_section)
+    {
+        throw std::runtime_error("The previous section of the k-mer file is not finished");
+    }
+
+    _in_section = true;
+    _section = { node, k, omega, 0, _position };
+    _log_threshold = get_log_threshold(omega, k);
+    _block.clear();
+    _index.clear();
+    _data.clear();
+}
+
+void kmer_writer::append(code_t kmer, score_t score)
+{
+    const bool first = _section.num_kmers == 0 && _block.empty();
+    if (!first && kmer <= _last_code)
+    {
+        throw std::runtime_error(kmer == _last_code
+                                 ? "Duplicate k-mer in a section of the k-mer file"
+                                 : "The k-mers of a section are not sorted by code");
+    }
+
+    _last_code = kmer;
+    _block.push_back({ kmer, score });
+    if (_block.size() == _block_size)
+    {
+        encode_block();
+    }
+}
+
+void kmer_writer::encode_block()
+{
+    if (_data.size() > UINT32_MAX)
+    {
+        throw std::runtime_error("A section of the k-mer file is too big");
+    }
+    put_fixed(_index, _block[0].kmer, sizeof(code_t));
+    put_fixed(_index, _data.size(), 4);
+
+    for (size_t i = 1; i < _block.size(); ++i)
+    {
+        put_varint(_data, _block[i].kmer - _block[i - 1].kmer);
+    }
+
+    for (const auto& [kmer, score] : _block)
+    {
+        if (_format == score_format::float32)
+        {
+            put_float(_data, score);
+        }
+        else
+        {
+            put_fixed(_data, quantize(score, _log_threshold), 2);
+        }
+    }
+
+    _section.num_kmers += _block.size();
+    _block.clear();
+}
+
+void kmer_writer::end_section()
+{
+    if (!_in_section)
+    {
+        throw std::runtime_error("No section of the k-mer file is being written");
+    }
+
+    if (!_block.empty())
+    {
+        encode_block();
+    }
+
+    std::string header;
+    put_string(header, _section.node);
+    put_varint(header, _section.k);
+    put_float(header, _section.omega);
+    put_fixed(header, static_cast<uint8_t>(_format), 1);
+    put_double(header, _log_threshold);
+    put_varint(header, _block_size);
+    put_varint(header, _section.num_kmers);
+    header += _index;
+    put_varint(header, _data.size());
+
+    std::string size;
+    put_fixed(size, header.size(), 4);
+    _file.write(size.data(), static_cast<std::streamsize>(size.size()));
+    _file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    _file.write(_data.data(), static_cast<std::streamsize>(_data.size()));
+    if (!_file)
+    {
+        throw std::runtime_error("Could not write the k-mer file");
+    }
+
+    _sections.push_back(_section);
+    _position += size.size() + header.size() + _data.size();
+
+    _in_section = false;
+    _index = std::string();
+    _data = std::string();
+}
+
+void kmer_writer::close()
+{
+    if (_closed)
+    {
+        return;
+    }
+    _closed = true;
+
+    std::string directory;
+    put_varint(directory, _sections.size());
+    for (const auto& section : _sections)
+    {
+        put_string(directory, section.node);
+        put_varint(directory, section.k);
+        put_float(directory, section.omega);
+        put_varint(directory, section.num_kmers);
+        put_fixed(directory, section.offset, 8);
+    }
+    put_fixed(directory, _position, 8);
+    directory.append(magic, sizeof(magic));
+
+    _file.write(directory.data(), static_cast<std::streamsize>(directory.size()));
+    _position += directory.size();
+    _file.close();
+    if (!_file)
+    {
+        throw std::runtime_error("Could not write the k-mer file");
+    }
+}
+
+size_t kmer_writer::bytes_written() const
+{
+    return _position;
+}
+
+kmer_reader::kmer_reader(const std::string& filename)
+    : _file(filename, std::ios::binary)
+    , _format(score_format::float32)
+    , _log_threshold(0.0)
+    , _block_size(0)
+    , _data_offset(0)
+    , _data_size(0)
+{
+    if (!_file)
+    {
+        throw std::runtime_error("Could not open " + filename);
+    }
+
+    const auto header = read_bytes(_file, 0, header_size);
+    byte_reader header_reader(header.data() + sizeof(magic), header.data() + header.size());
+    if (std::memcmp(header.data(), magic, sizeof(magic)) != 0 || header_reader.fixed(4) != version)
+    {
+        throw std::runtime_error("Not a k-mer file of a supported version: " + filename);
+    }
+    const auto code_size = header_reader.fixed(1);
+    if (code_size != sizeof(code_t))
+    {
+        throw std::runtime_error("The k-mer file " + filename + " has " + std::to_string(8 * code_size) +
+                                 "-bit codes, this build reads " + std::to_string(8 * sizeof(code_t)) + "-bit codes");
+    }
+
+    _file.seekg(0, std::ios::end);
+    const auto file_size = static_cast<uint64_t>(_file.tellg());
+    if (file_size < header.size() + trailer_size)
+    {
+        throw std::runtime_error("Corrupted k-mer file: " + filename);
+    }
+    const auto trailer = read_bytes(_file, file_size - trailer_size, trailer_size);
+    const auto directory_offset = byte_reader(trailer.data(), trailer.data() + 8).fixed(8);
+    if (std::memcmp(trailer.data() + 8, magic, sizeof(magic)) != 0 || directory_offset > file_size - trailer_size)
+    {
+        throw std::runtime_error("Corrupted k-mer file, it may not have been closed: " + filename);
+    }
+
+    const auto directory = read_bytes(_file, directory_offset, file_size - trailer_size - directory_offset);
+    byte_reader reader(directory.data(), directory.data() + directory.size());
+    const auto num_sections = reader.varint();
+    for (size_t i = 0; i < num_sections; ++i)
+    {
+        section_info section;
+        section.node = reader.string();
+        section.k = reader.varint();
+        section.omega = reader.real();
+        section.num_kmers = reader.varint();
+        section.offset = reader.fixed(8);
+        _sections.push_back(std::move(section));
+    }
+}
+
+const std::vector<section_info>& kmer_reader::sections() const
+{
+    return _sections;
+}
+
+std::vector<phylo_kmer> kmer_reader::read(size_t section)
+{
+    std::vector<phylo_kmer> result;
+    result.reserve(_sections.at(section).num_kmers);
+    for_each(section, [&result](const phylo_kmer& kmer) { result.push_back(kmer); });
+    return result;
+}
+
+std::optional<score_t> kmer_reader::find(size_t section, code_t kmer)
+{
+    open_section(section);
+
+    /// The last block that starts at or before the k-mer
+    const auto it = std::upper_bound(_index.begin(), _index.end(), kmer,
+                                     [](code_t code, const block_entry& entry) { return code < entry.first_code; });
+    if (it == _index.begin())
+    {
+        return std::nullopt;
+    }
+
+    std::vector<phylo_kmer> block;
+    decode_block(static_cast<size_t>(it - _index.begin()) - 1, block);
+    const auto found = std::lower_bound(block.begin(), block.end(), kmer,
+                                        [](const phylo_kmer& a, code_t code) { return a.kmer < code; });
+    if (found != block.end() && found->kmer == kmer)
+    {
+        return found->score;
+    }
+    return std::nullopt;
+}
+
+void kmer_reader::open_section(size_t section)
+{
+    if (_section == section)
+    {
+        return;
+    }
+
+    const auto& info = _sections.at(section);
+    const auto size_bytes = read_bytes(_file, info.offset, 4);
+    const auto size = byte_reader(size_bytes.data(), size_bytes.data() + size_bytes.size()).fixed(4);
+    const auto header = read_bytes(_file, info.offset + 4, size);
+
+    byte_reader reader(header.data(), header.data() + header.size());
+    reader.string();
+    reader.varint();
+    reader.real();
+    _format = static_cast<score_format>(reader.fixed(1));
+    _log_threshold = reader.real64();
+    _block_size = reader.varint();
+    const auto num_kmers = reader.varint();
+    if (_block_size == 0 || num_kmers != info.num_kmers || !std::isfinite(_log_threshold) || _log_threshold >= 0.0)
+    {
+        throw std::runtime_error("Corrupted k-mer file: bad section header");
+    }
+
+    const auto num_blocks = (num_kmers + _block_size - 1) / _block_size;
+    _index.clear();
+    _index.reserve(num_blocks);
+    for (size_t b = 0; b < num_blocks; ++b)
+    {
+        const auto first_code = reader.fixed<code_t>(sizeof(code_t));
+        const auto offset = static_cast<uint32_t>(reader.fixed(4));
+        _index.push_back({ first_code, offset });
+    }
+    _data_size = reader.varint();
+    _data_offset = info.offset + 4 + size;
+    _section = section;
+}
+
+void kmer_reader::decode_block(size_t block, std::vector<phylo_kmer>& kmers)
+{
+    const auto& info = _sections[*_section];
+    const auto begin = _index[block].offset;
+    const auto end = (block + 1 < _index.size()) ? _index[block + 1].offset : _data_size;
+    const auto num_kmers = std::min(_block_size, info.num_kmers - block * _block_size);
+
+    const auto bytes = read_bytes(_file, _data_offset + begin, end - begin);
+    byte_reader reader(bytes.data(), bytes.data() + bytes.size());
+
+    kmers.resize(num_kmers);
+    kmers[0].kmer = _index[block].first_code;
+    for (size_t i = 1; i < num_kmers; ++i)
+    {
+        kmers[i].kmer = kmers[i - 1].kmer + reader.varint<code_t>();
+    }
+    for (auto& kmer : kmers)
+    {
+        kmer.score = (_format == score_format::float32)
+            ? reader.real()
+            : dequantize(static_cast<uint16_t>(reader.fixed(2)), _log_threshold);
+    }
+}
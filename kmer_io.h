@@ -0,0 +1,160 @@
+#ifndef XPAS_ALGS_KMER_IO_H
+#define XPAS_ALGS_KMER_IO_H
+
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "common.h"
+
+/// How the scores are stored in the binary format
+enum class score_format : uint8_t
+{
+    // 4 bytes per score, exact
+    float32 = 0,
+
+    // 2 bytes per score: the log of the score is quantized uniformly between log(threshold) and 0.
+    // The relative error is at most -log(threshold) / 2^17
+    log16 = 1
+};
+
+/// The lower end of the quantized log-scores: every stored k-mer is over the threshold.
+/// Always finite and negative: for a zero threshold (omega = 0), the log of the smallest positive float.
+/// The value used by a section is stored in its header
+double get_log_threshold(score_t omega, size_t k);
+
+/// A score as its log quantized to 16 bits between log_threshold and 0, and back
+uint16_t quantize(score_t score, double log_threshold);
+
+score_t dequantize(uint16_t value, double log_threshold);
+
+/// A section of the binary format: the k-mers of a node (or of a range of its windows) for some k and omega
+struct section_info
+{
+    std::string node;
+    size_t k;
+    score_t omega;
+    size_t num_kmers;
+
+    // the position of the section in the file
+    uint64_t offset;
+};
+
+/// Writes phylo-k-mers in a compact binary format.
+///
+/// The file is a header, a sequence of sections, and a directory of the sections at the end.
+/// The k-mers of a section are sorted by code and split into blocks of a fixed size. Inside a block,
+/// the codes are stored as varint deltas from the previous one, followed by the scores.
+/// The first code and the byte offset of every block go into the block index of the section,
+/// so a single k-mer can be found by decoding one block. The header records the width of the codes,
+/// a file can only be read by a build with the same width.
+class kmer_writer
+{
+public:
+    kmer_writer(const std::string& filename, score_format format, size_t block_size = 256);
+    kmer_writer(const kmer_writer&) = delete;
+    kmer_writer(kmer_writer&&) = delete;
+    kmer_writer& operator=(const kmer_writer&) = delete;
+    kmer_writer& operator=(kmer_writer&&) = delete;
+    ~kmer_writer() noexcept;
+
+    /// Writes a section. The k-mers have to be unique, they are sorted here
+    void write(const std::string& node, size_t k, score_t omega, std::vector<phylo_kmer> kmers);
+
+    /// Writes a section from k-mers appended in the order of codes, e.g. merged from the runs on disk
+    /// of a spill_sink. Only the encoded section is kept in memory until end_section:
+    /// the block index goes before the data in the file
+    void begin_section(const std::string& node, size_t k, score_t omega);
+
+    void append(code_t kmer, score_t score);
+
+    void end_section();
+
+    /// Writes the directory of sections and closes the file
+    void close();
+
+    size_t bytes_written() const;
+
+private:
+    void encode_block();
+
+    std::ofstream _file;
+    score_format _format;
+    size_t _block_size;
+
+    /// The section being written
+    bool _in_section;
+    section_info _section;
+    double _log_threshold;
+    code_t _last_code;
+    std::vector<phylo_kmer> _block;
+    std::string _index;
+    std::string _data;
+
+    std::vector<section_info> _sections;
+    uint64_t _position;
+    bool _closed;
+};
+
+/// Reads the binary format written by kmer_writer. Sections are decoded block by block,
+/// only the block index of a section is kept in memory
+class kmer_reader
+{
+public:
+    explicit kmer_reader(const std::string& filename);
+    kmer_reader(const kmer_reader&) = delete;
+    kmer_reader(kmer_reader&&) = delete;
+    kmer_reader& operator=(const kmer_reader&) = delete;
+    kmer_reader& operator=(kmer_reader&&) = delete;
+    ~kmer_reader() noexcept = default;
+
+    const std::vector<section_info>& sections() const;
+
+    /// Calls f(kmer) for every k-mer of the section in the order of codes
+    template<typename F>
+    void for_each(size_t section, F&& f)
+    {
+        open_section(section);
+        std::vector<phylo_kmer> block;
+        for (size_t b = 0; b < _index.size(); ++b)
+        {
+            decode_block(b, block);
+            for (const auto& kmer : block)
+            {
+                f(kmer);
+            }
+        }
+    }
+
+    /// All the k-mers of the section in the order of codes
+    std::vector<phylo_kmer> read(size_t section);
+
+    /// The score of the k-mer in the section, if it is there
+    std::optional<score_t> find(size_t section, code_t kmer);
+
+private:
+    struct block_entry
+    {
+        code_t first_code;
+        uint32_t offset;
+    };
+
+    /// Reads the header and the block index of a section, if it is not the current one
+    void open_section(size_t section);
+
+    void decode_block(size_t block, std::vector<phylo_kmer>& kmers);
+
+    std::ifstream _file;
+    std::vector<section_info> _sections;
+
+    /// The current section
+    std::optional<size_t> _section;
+    score_format _format;
+    double _log_threshold;
+    size_t _block_size;
+    std::vector<block_entry> _index;
+    uint64_t _data_offset;
+    uint64_t _data_size;
+};
+
+#endif //XPAS_ALGS_KMER_IO_H
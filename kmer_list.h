@@ -0,0 +1,156 @@
+#ifndef XPAS_ALGS_KMER_LIST_H
+#define XPAS_ALGS_KMER_LIST_H
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "common.h"
+
+/// K-mers as a structure of arrays: the codes and the scores are kept in separate arrays of the same size.
+/// phylo_kmer is padded to twice the size of its fields for 64-bit codes, and the passes that only look
+/// at the scores (threshold filters, partitions, the keys of sorting) read the scores alone here,
+/// without the codes and the padding, in loops the compiler can vectorize.
+///
+/// A list is a sink, engines can emit into it
+class kmer_list
+{
+public:
+    kmer_list() = default;
+
+    void emit(code_t kmer, score_t score)
+    {
+        push_back(kmer, score);
+    }
+
+    void push_back(code_t kmer, score_t score)
+    {
+        _codes.push_back(kmer);
+        _scores.push_back(score);
+    }
+
+    size_t size() const
+    {
+        return _scores.size();
+    }
+
+    bool empty() const
+    {
+        return _scores.empty();
+    }
+
+    void clear()
+    {
+        _codes.clear();
+        _scores.clear();
+    }
+
+    void reserve(size_t size)
+    {
+        _codes.reserve(size);
+        _scores.reserve(size);
+    }
+
+    code_t code(size_t i) const
+    {
+        return _codes[i];
+    }
+
+    score_t score(size_t i) const
+    {
+        return _scores[i];
+    }
+
+    /// The views of the arrays
+    const std::vector<code_t>& get_codes() const
+    {
+        return _codes;
+    }
+
+    const std::vector<score_t>& get_scores() const
+    {
+        return _scores;
+    }
+
+    /// Moves the k-mers with the score > threshold to the front, in no particular order.
+    /// Returns their number. The codes are only touched to swap them
+    size_t partition(score_t threshold)
+    {
+        size_t first = 0;
+        size_t last = size();
+        for (;;)
+        {
+            while (first < last && _scores[first] > threshold)
+            {
+                ++first;
+            }
+            while (first < last && !(_scores[last - 1] > threshold))
+            {
+                --last;
+            }
+            if (first == last)
+            {
+                return first;
+            }
+            --last;
+            std::swap(_scores[first], _scores[last]);
+            std::swap(_codes[first], _codes[last]);
+            ++first;
+        }
+    }
+
+    /// Sorts the first count k-mers by score, the best first. The permutation is found by sorting
+    /// the score bits packed with the positions into 64-bit keys, then the codes and the scores are gathered
+    void sort_by_score(size_t count)
+    {
+        if (count > UINT32_MAX)
+        {
+            throw std::runtime_error("Too many k-mers to sort by score");
+        }
+
+        static_assert(sizeof(score_t) == sizeof(uint32_t), "The scores are sorted by their 32 bits");
+
+        // The scores are not negative, so their bits compare as unsigned integers.
+        // Inverted to sort the best first
+        std::vector<uint64_t> keys(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &_scores[i], sizeof(bits));
+            keys[i] = (static_cast<uint64_t>(~bits) << 32) | i;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<code_t> codes(count);
+        std::vector<score_t> scores(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto position = static_cast<uint32_t>(keys[i]);
+            codes[i] = _codes[position];
+            scores[i] = _scores[position];
+        }
+        std::copy(codes.begin(), codes.end(), _codes.begin());
+        std::copy(scores.begin(), scores.end(), _scores.begin());
+    }
+
+    void sort_by_score()
+    {
+        sort_by_score(size());
+    }
+
+    std::vector<phylo_kmer> to_vector() const
+    {
+        std::vector<phylo_kmer> result(size());
+        for (size_t i = 0; i < size(); ++i)
+        {
+            result[i] = { _codes[i], _scores[i] };
+        }
+        return result;
+    }
+
+private:
+    std::vector<code_t> _codes;
+    std::vector<score_t> _scores;
+};
+
+#endif //XPAS_ALGS_KMER_LIST_H
@@ -1,16 +1,45 @@
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
 #include <unordered_map>
 #include <vector>
 #include <cmath>
 #include <cassert>
+#include <cstring>
 #include <chrono>
 #include <fstream>
 #include <iterator>
+#include <limits>
 #include <filesystem>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 
 #include "common.h"
 #include "dc.h"
 #include "bb.h"
+#include "hybrid.h"
+#include "autotune.h"
+#include "bands.h"
+#include "table.h"
+#include "pool.h"
+#include "queue.h"
+#include "kmer_io.h"
+#include "sink.h"
+#include "arena.h"
+#include "estimate.h"
+#include "dense.h"
+#include "radix.h"
+#include "spill.h"
+#include "database.h"
+#include "encode.h"
+#include "place.h"
+#include "direct.h"
 #include "brute_force.h"
 #include "ar.h"
 
@@ -25,8 +54,73 @@ struct flags
     bool run_bb;
     bool run_dc;
     bool run_dccw;
+    bool run_sbb;
+    bool run_hybrid;
+    bool run_auto;
+    bool run_topn;
+    bool run_lazy;
+    bool run_multi_omega;
+    bool run_multi_k;
+    bool run_count;
 };
 
+struct run_options
+{
+    /// The cost model used to choose the algorithm for every window in the auto mode
+    std::string model_file;
+
+    /// If not empty, a cost model is fitted to the running times of this run and saved there
+    std::string calibrate_file;
+
+    /// The number of k-mers per window kept by the top-N mode, or consumed by the lazy mode
+    size_t top_n = 1000;
+
+    /// The number of threads of the parallel driver. With one thread, the nodes are computed in order.
+    /// In the pipeline, the number of enumerator threads
+    size_t num_threads = 1;
+
+    /// Read, compute and write the nodes in a pipeline of stages instead of loading the whole file first
+    bool pipeline = false;
+
+    /// The number of threads that split the nodes into ranges of windows in the pipeline
+    size_t num_windowers = 1;
+
+    /// The number of nodes read ahead of the enumerators in the pipeline. The queues of ranges and results
+    /// hold this many per enumerator thread
+    size_t queue_capacity = 4;
+
+    /// The number of window positions in a range of the pipeline
+    size_t range_size = 256;
+
+    /// If not empty, the k-mers computed by BB (or DC, or DCCW) are stored there in the binary format.
+    /// A node gets a section per pair of k and omega, or per range of windows if it is split
+    std::string kmers_file;
+
+    /// Store the scores as 16-bit quantized logarithms instead of floats
+    bool quantize = false;
+
+    /// Back the buffers reused across windows with transparent huge pages
+    bool huge_pages = false;
+
+    /// The stored k-mers of a node are aggregated in a dense table instead of a map if k is small enough
+    /// and the estimated fraction of the k-mers that pass the threshold is at least this
+    double dense_fill_ratio = 0.25;
+
+    /// The memory for the stored k-mers of a node in bytes, zero for no limit. Beyond it, the k-mers are spilled
+    /// in sorted runs to temporary files in spill_dir (or the system temporary directory), merged when written
+    size_t memory_budget = 0;
+    std::string spill_dir;
+
+    /// If not empty, a phylo-k-mer database is built there from the stored k-mers, per pair of k and omega
+    std::string database_file;
+};
+
+/// The order of the algorithm flags on the command line
+const std::vector<bool flags::*> flag_order = { &flags::run_bb, &flags::run_dc, &flags::run_dccw, &flags::run_sbb,
+                                                 &flags::run_hybrid, &flags::run_auto, &flags::run_topn,
+                                                 &flags::run_lazy, &flags::run_multi_omega,
+                                                 &flags::run_multi_k, &flags::run_count };
+
 const std::vector<run_params> params =
     {
         { 6, 1.0},
@@ -168,11 +262,34 @@ const std::vector<run_params> params_omega_2_even_k =
         //{ 14, 1.5},
     };
 
+/// The omega values of the parameters for every k
+std::map<size_t, std::vector<score_t>> group_by_k(const std::vector<run_params>& parameters)
+{
+    std::map<size_t, std::vector<score_t>> result;
+    for (const auto& [k, omega] : parameters)
+    {
+        result[k].push_back(omega);
+    }
+    return result;
+}
+
+/// The values of k of the parameters for every omega
+std::map<score_t, std::vector<size_t>> group_by_omega(const std::vector<run_params>& parameters)
+{
+    std::map<score_t, std::vector<size_t>> result;
+    for (const auto& [k, omega] : parameters)
+    {
+        result[omega].push_back(k);
+    }
+    return result;
+}
+
 void print_map(const map_t& map)
 {
     for (const auto& [kmer, score] : map)
     {
-        std::cout << kmer << ": " << score << std::endl;
+        // the low 64 bits of the code, streams do not print 128-bit integers
+        std::cout << static_cast<uint64_t>(kmer) << ": " << score << std::endl;
     }
     std::cout << std::endl;
 }
@@ -202,13 +319,13 @@ void assert_equal(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer
 {
     assert(a.size() == b.size());
 
-    std::unordered_map<code_t, score_t> map_a;
+    map_t map_a;
     for (const auto& [kmer, score] : a)
     {
         map_a[kmer] = score;
     }
 
-    std::unordered_map<code_t, score_t> map_b;
+    map_t map_b;
     for (const auto& [kmer, score] : b)
     {
         map_b[kmer] = score;
@@ -216,22 +333,39 @@ void assert_equal(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer
     assert_equal_map(map_a, map_b);
 }
 
-void check_size(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer>& b)
+/// The same k-mers with the same scores, except the ones within rounding of the threshold
+/// that only one of the engines keeps
+void assert_equal_at_threshold(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer>& b, score_t eps)
 {
-    if (a.size() != b.size())
+    map_t map_a;
+    for (const auto& [kmer, score] : a)
     {
-        std::cout << "Different sizes: " << a.size() << ", " << b.size() << std::endl;
+        map_a[kmer] = score;
+    }
+
+    map_t map_b;
+    for (const auto& [kmer, score] : b)
+    {
+        map_b[kmer] = score;
+    }
+
+    for (const auto& [kmer, score] : map_a)
+    {
+        const auto it = map_b.find(kmer);
+        assert(it == map_b.end() ? fabs(score - eps) <= eps * 1e-5 : fabs(score - it->second) < 1e-6);
+    }
+    for (const auto& [kmer, score] : map_b)
+    {
+        assert(map_a.find(kmer) != map_a.end() || fabs(score - eps) <= eps * 1e-5);
     }
 }
 
-score_t shannon(const std::vector<score_t>& values)
+void check_size(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer>& b)
 {
-    score_t result = 0.0;
-    for (const auto& v : values)
+    if (a.size() != b.size())
     {
-        result += v * static_cast<score_t>(log2(v));
+        std::cout << "Different sizes: " << a.size() << ", " << b.size() << std::endl;
     }
-    return - result;
 }
 
 // Get the order of columns by entropy
@@ -259,14 +393,17 @@ void test_one(size_t k, bool print=true)
     if (print)
     {
         print_matrix(matrix);
-        std::cout << "Threshold: " << std::pow((omega / 4), k) << std::endl;
+        std::cout << "Threshold: " << get_threshold(omega, k) << std::endl;
     }
 
+    std::vector<phylo_kmer> suffixes;
+    size_t num_kmers = 0;
     for (const auto& window : to_windows(matrix, k))
     {
         //std::cout << "WINDOW: " << window.get_position() << std::endl;
         branch_and_bound bb(window, k, omega);
         bb.run(omega);
+        num_kmers += bb.get_num_kmers();
         if (print)
         {
             //print_map(bb.get_map());
@@ -297,6 +434,50 @@ void test_one(size_t k, bool print=true)
         {
             //print_map(dc.get_map());
             std::cout << "Divide-and-conquer, generated: " << dc.get_result().size() << std::endl;
+        }
+
+        dc_count count(window, k, omega);
+        count.run(omega);
+        assert(count.get_num_kmers() == dc.get_num_kmers());
+
+        /// The SoA list keeps the codes with their scores through the partition and the sort
+        kmer_list list;
+        map_t bb_scores;
+        for (const auto& [kmer, score] : bb.get_result())
+        {
+            list.push_back(kmer, score);
+            bb_scores[kmer] = score;
+        }
+        const auto eps = get_threshold(omega, k);
+        const auto half = list.partition(std::sqrt(eps));
+        list.sort_by_score(half);
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            assert((i < half) == (list.score(i) > std::sqrt(eps)));
+            assert(i == 0 || i >= half || list.score(i - 1) >= list.score(i));
+            assert(bb_scores.at(list.code(i)) == list.score(i));
+        }
+
+        /// The dense table computes the scores in the same order as BB
+        std::vector<phylo_kmer> dense_result;
+        vector_sink dense_sink(dense_result);
+        dense_table(k).run(window, omega, dense_sink);
+        assert(dense_result.size() == bb.get_num_kmers());
+        for (const auto& [kmer, score] : bb.get_result())
+        {
+            const auto it = std::lower_bound(dense_result.begin(), dense_result.end(), kmer,
+                                             [](const phylo_kmer& a, code_t b) { return a.kmer < b; });
+            assert(it != dense_result.end() && it->kmer == kmer && it->score == score);
+        }
+
+        /// Leave a bit of room for the rounding of the products at the threshold
+        const auto size = size_estimator().estimate(window, k, omega);
+        const auto num_dc = static_cast<double>(dc.get_num_kmers());
+        assert(size.lower <= num_dc + 1 && num_dc <= size.upper + 1);
+        assert(size.lower <= size.estimate && size.estimate <= size.upper);
+        if (print)
+        {
+            std::cout << "Count, counted: " << count.get_num_kmers() << std::endl;
             std::cout << std::endl;
         }
 
@@ -312,265 +493,1679 @@ void test_one(size_t k, bool print=true)
         matrix.sort();*/
 
 
-        assert_equal(bb.get_result(), dc.get_result());
+        score_t lookahead = 0.0f;
+        if (window.get_position() + 1 + k < matrix.width())
+        {
+            lookahead = window.max_at(k).second;
+        }
+        sliding_bb sbb(window, suffixes, k, lookahead);
+        sbb.run(omega);
+        if (print)
+        {
+            std::cout << "Sliding branch-and-bound, generated: " << sbb.get_result().size() << std::endl;
+        }
+
+        hybrid hybrid(window, k);
+        hybrid.run(omega);
+        if (print)
+        {
+            std::cout << "Hybrid, generated: " << hybrid.get_result().size() << std::endl;
+        }
+
+        assert_equal_at_threshold(bb.get_result(), dc.get_result(), get_threshold(omega, k));
+        assert_equal_at_threshold(bb.get_result(), sbb.get_result(), get_threshold(omega, k));
+        assert_equal_at_threshold(bb.get_result(), hybrid.get_result(), get_threshold(omega, k));
+
+        const size_t n = 50;
+        top_n topn(window, k, n);
+        topn.run(omega);
+        const auto& bb_result = bb.get_result();
+        auto best = bb_result;
+        std::sort(best.begin(), best.end(), kmer_score_comparator);
+        const auto topn_result = topn.get_result();
+        assert(topn_result.size() == std::min(n, best.size()));
+        for (size_t i = 0; i < topn_result.size(); ++i)
+        {
+            assert(fabs(topn_result[i].score - best[i].score) < 1e-6);
+        }
+
+        lazy_bb lazy(window, k, omega);
+        std::vector<phylo_kmer> lazy_result;
+        for (const auto& kmer : lazy)
+        {
+            assert(lazy_result.empty() || kmer.score <= lazy_result.back().score * (1 + 1e-6));
+            lazy_result.push_back(kmer);
+        }
+        assert_equal(bb.get_result(), lazy_result);
+
+        omega_bands bands({ 2.0, omega, 1.5 }, k);
+        bands.add(bb.get_result());
+        for (size_t b = 0; b < bands.size(); ++b)
+        {
+            branch_and_bound bb_omega(window, k, bands.get_omegas()[b]);
+            bb_omega.run(bands.get_omegas()[b]);
+            assert(bb_omega.get_num_kmers() == bands.get_num_kmers(b));
+
+            /// The result for omega_b is the union of the bands from b on
+            std::vector<phylo_kmer> union_bands;
+            for (size_t b2 = b; b2 < bands.size(); ++b2)
+            {
+                for (const auto& kmer : bands.get_band(b2))
+                {
+                    assert(bands.band(kmer.score) == b2);
+                    union_bands.push_back(kmer);
+                }
+            }
+            assert_equal(bb_omega.get_result(), union_bands);
+        }
+
+        if (window.get_position() + k + 2 < matrix.width())
+        {
+            const auto wide_window = ::window(matrix, window.get_position(), k + 2);
+            multi_k_bb bb_multi_k(wide_window, { k + 2, k });
+            bb_multi_k.run(omega);
+            assert_equal(bb.get_result(), bb_multi_k.get_result(0));
+        }
+
+        /// BB and DC inserted from two threads, against the best scores of both
+        kmer_table table(2 * (bb.get_num_kmers() + dc.get_num_kmers()));
+        std::thread bb_inserter([&table, &bb]() { table.insert_max(std::as_const(bb).get_result()); });
+        table.insert_max(dc.get_result());
+        bb_inserter.join();
+        map_t bb_dc_best;
+        for (const auto* kmers : { &std::as_const(bb).get_result(), &dc.get_result() })
+        {
+            for (const auto& [kmer, score] : *kmers)
+            {
+                const auto it = bb_dc_best.find(kmer);
+                bb_dc_best[kmer] = (it == bb_dc_best.end()) ? score : std::max(it->second, score);
+            }
+        }
+        const auto table_kmers = table.to_vector();
+        assert(table_kmers.size() == bb_dc_best.size());
+        for (const auto& [kmer, score] : table_kmers)
+        {
+            assert(bb_dc_best.at(kmer) == score);
+        }
+
+        count_sink counter;
+        branch_and_bound bb_count(window, k, omega);
+        bb_count.run(omega, counter);
+        assert(counter.get_count() == bb.get_num_kmers() && bb_count.get_num_kmers() == 0);
+
+        count_sink hybrid_counter;
+        ::hybrid hybrid_count(window, k);
+        hybrid_count.run(omega, hybrid_counter);
+        assert(hybrid_counter.get_count() == hybrid.get_num_kmers() && hybrid_count.get_num_kmers() == 0);
+
+        std::vector<phylo_kmer> topn_sunk;
+        vector_sink topn_sink(topn_sunk);
+        top_n(window, k, n).run(omega, topn_sink);
+        std::sort(topn_sunk.begin(), topn_sunk.end(), kmer_score_comparator);
+        assert(topn_sunk.size() == topn_result.size());
+        for (size_t i = 0; i < topn_sunk.size(); ++i)
+        {
+            assert(topn_sunk[i].score == topn_result[i].score);
+        }
+
+        histogram_sink histogram(omega, k, 16);
+        divide_and_conquer dc_histogram(window, k, omega);
+        dc_histogram.run(omega, histogram);
+        const auto& bins = histogram.get_bins();
+        assert(std::accumulate(bins.begin(), bins.end(), size_t{ 0 }) == dc.get_num_kmers());
+
+        /// The threshold is 0 for omega = 0 and 1 for omega = sigma
+        for (const auto histogram_omega : { 0.0f, static_cast<score_t>(sigma) })
+        {
+            histogram_sink edge_histogram(histogram_omega, k, 16);
+            dc_histogram.run(omega, edge_histogram);
+            edge_histogram.emit(0, 0.0f);
+            const auto& edge_bins = edge_histogram.get_bins();
+            assert(std::accumulate(edge_bins.begin(), edge_bins.end(), size_t{ 0 }) == dc.get_num_kmers() + 1);
+        }
+
+        /// The second window emitted into the arena reuses its memory
+        for (const bool huge_pages : { false, true })
+        {
+            kmer_arena arena(huge_pages);
+            branch_and_bound bb_arena(window, k, omega);
+            bb_arena.run(omega, arena);
+            assert_equal(bb.get_result(), arena.to_vector());
+
+            const auto capacity = arena.capacity();
+            arena.clear();
+            bb_arena.run(omega, arena);
+            assert(arena.size() == bb.get_num_kmers() && arena.capacity() == capacity);
+        }
+
+        kmer_table dc_table(2 * dc.get_num_kmers());
+        table_sink dc_table_sink(dc_table);
+        divide_and_conquer dc_sink(window, k, omega);
+        dc_sink.run(omega, dc_table_sink);
+        assert_equal(dc.get_result(), dc_table.to_vector());
         //assert_equal(dc.get_result(), dccw.get_result());
 
         //assert_equal(bb.get_map(), bf.get_map());
         //assert_equal(rap.get_map(), bf.get_map());
     }
 
-}
+    /// The same windows on the pool, one task per window
+    work_stealing_pool pool(4);
+    std::vector<size_t> worker_kmers(pool.size(), 0);
+    for (const auto& window : to_windows(matrix, k))
+    {
+        const auto position = window.get_position();
+        pool.submit([&, position](size_t worker) {
+            const auto task_window = ::window(matrix, position, k);
+            branch_and_bound bb(task_window, k, omega);
+            bb.run(omega);
+            worker_kmers[worker] += bb.get_num_kmers();
+        });
+    }
+    pool.run();
+    assert(std::accumulate(worker_kmers.begin(), worker_kmers.end(), size_t{ 0 }) == num_kmers);
+
+    /// The same windows through a small queue, with two producers and two consumers
+    const size_t num_windows = matrix.width() - k;
+    bounded_queue<size_t> positions(2);
+    std::atomic<size_t> queue_kmers = 0;
+    std::atomic<size_t> num_producers = 2;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 2; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (size_t position = t; position < num_windows; position += 2)
+            {
+                positions.push(position);
+            }
+            if (num_producers.fetch_sub(1) == 1)
+            {
+                positions.close();
+            }
+        });
+        threads.emplace_back([&]() {
+            while (const auto position = positions.pop())
+            {
+                const auto task_window = ::window(matrix, *position, k);
+                branch_and_bound bb(task_window, k, omega);
+                bb.run(omega);
+                queue_kmers += bb.get_num_kmers();
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    assert(queue_kmers == num_kmers);
 
-void test_suite()
-{
-    const size_t num_iter = 100;
-    const std::vector<size_t> k_values = { 6, 7, 8, 9 };
+    /// The best scores of the node in a dense table and in a map
+    dense_table node_table(k);
+    map_t node_best;
+    max_sink node_sink(node_best);
+    for (const auto& window : to_windows(matrix, k))
+    {
+        node_table.add_max(window, omega);
+        branch_and_bound bb(window, k, omega);
+        bb.run(omega, node_sink);
+    }
+    std::vector<phylo_kmer> node_kmers;
+    vector_sink node_kmers_sink(node_kmers);
+    node_table.emit_max(node_kmers_sink);
+    assert(node_kmers.size() == node_best.size());
+    for (const auto& [kmer, score] : node_kmers)
+    {
+        assert(node_best.at(kmer) == score);
+    }
 
-    for (const auto k : k_values)
+    /// The same maxima by sorting and merging, and the parallel radix sort against a stable sort
+    sorted_max_sink sorted_best(k);
+    std::vector<phylo_kmer> all_kmers;
+    for (const auto& window : to_windows(matrix, k))
     {
-        for (size_t i = 0; i < num_iter; ++i)
+        branch_and_bound bb(window, k, omega);
+        bb.run(omega);
+        const auto& window_kmers = std::as_const(bb).get_result();
+        for (const auto& [kmer, score] : window_kmers)
         {
-            std::cout << "\rTesting k = " << k << ". " << i << " / " << num_iter << "..." << std::flush;
-            test_one(k, false);
+            sorted_best.emit(kmer, score);
         }
-        std::cout << "\rTesting k = " << k << ". Done." << std::endl;
+        all_kmers.insert(all_kmers.end(), window_kmers.begin(), window_kmers.end());
+    }
+    const auto& merged = sorted_best.get_result();
+    assert(merged.size() == node_best.size());
+    for (size_t i = 0; i < merged.size(); ++i)
+    {
+        assert(node_best.at(merged[i].kmer) == merged[i].score);
+        assert(i == 0 || merged[i - 1].kmer < merged[i].kmer);
     }
-}
 
+    auto radix_sorted = all_kmers;
+    radix_sort(radix_sorted, k, 4);
+    std::stable_sort(all_kmers.begin(), all_kmers.end(),
+                     [](const phylo_kmer& a, const phylo_kmer& b) { return a.kmer < b.kmer; });
+    for (size_t i = 0; i < all_kmers.size(); ++i)
+    {
+        assert(radix_sorted[i].kmer == all_kmers[i].kmer && radix_sorted[i].score == all_kmers[i].score);
+    }
+}
 
-enum class algorithm
+/// A random node for the tests of storing and scoring k-mers
+struct test_node
 {
-    bb = 0,
-    dc = 1,
-    rappas = 2,
-    dccw = 3,
-    baseline = 4,
-    bbe = 5
-};
+    ::matrix data;
 
-struct run_stats
-{
-    algorithm alg;
-    size_t num_kmers;
-    unsigned long time;
-    size_t k;
-    score_t omega;
-    std::string node;
-    size_t window_pos;
+    /// The best score of every k-mer over the windows of the node, and the same in the order of codes
+    map_t best;
+    std::vector<phylo_kmer> kmers;
+
+    /// The k-mers of the first window
+    std::vector<phylo_kmer> first_kmers;
 };
 
-void print_as_csv(const std::vector<run_stats>& stats, const std::string& filename)
+test_node make_test_node(size_t k, score_t omega)
 {
-    std::cout << "Writing results: " << filename << "...";
+    test_node node{ generate(2 * k), {}, {}, {} };
+    max_sink sink(node.best);
+    for (const auto& window : to_windows(node.data, k))
+    {
+        branch_and_bound bb(window, k, omega);
+        bb.run(omega, sink);
+    }
+    for (const auto& [kmer, score] : node.best)
+    {
+        node.kmers.push_back({ kmer, score });
+    }
+    std::sort(node.kmers.begin(), node.kmers.end(),
+              [](const phylo_kmer& a, const phylo_kmer& b) { return a.kmer < b.kmer; });
+
+    const auto first_window = ::window(node.data, 0, k);
+    branch_and_bound first_bb(first_window, k, omega);
+    first_bb.run(omega);
+    node.first_kmers = std::as_const(first_bb).get_result();
+    return node;
+}
 
-    std::ofstream file(filename);
-    file << "alg,num_kmers,time,k,omega,node,position" << std::endl;
-    for (const auto& stat: stats)
+/// The k-mers of the first window through the binary format, exact and quantized
+void test_kmer_io(size_t k)
+{
+    const score_t omega = 1.0;
+    const auto node = make_test_node(k, omega);
+    const auto& first_kmers = node.first_kmers;
+    const auto kmers_file = (std::filesystem::temp_directory_path() / "xpas_algs_test_kmers.bin").string();
+    for (const auto format : { score_format::float32, score_format::log16 })
     {
-        const auto& [alg, num_kmers, time, k, omega, node, position] = stat;
+        {
+            kmer_writer writer(kmers_file, format, 16);
+            writer.write("node", k, omega, first_kmers);
+            writer.write("empty", k, omega, {});
+        }
 
-        switch (alg)
-        {
-            case algorithm::bb:
-                file << "bb";
-                break;
-            case algorithm::dc:
-                file << "dc";
-                break;
-            case algorithm::dccw:
-                file << "dccw";
-                break;
-            case algorithm::rappas:
-                file << "rappas";
-                break;
-            case algorithm::baseline:
-                file << "bl";
-                break;
-            case algorithm::bbe:
-                file << "bbe";
-                break;
-        }
-        file << "," << num_kmers << "," << time << "," << k << "," << omega << "," << node << "," << position << std::endl;
+        kmer_reader reader(kmers_file);
+        assert(reader.sections().size() == 2);
+        assert(reader.sections()[0].num_kmers == first_kmers.size() && reader.sections()[1].num_kmers == 0);
+        const auto stored = reader.read(0);
+        assert(stored.size() == first_kmers.size());
+        for (const auto& [kmer, score] : first_kmers)
+        {
+            const auto found = reader.find(0, kmer);
+            assert(found && fabs(*found / score - 1) < 1e-3);
+        }
+        assert(!reader.find(0, ~code_t{ 0 } >> 1));
     }
-    file.close();
 
-    std::cout << std::endl;
+    /// With omega = 0 the threshold is 0, the quantized scores still come back
+    {
+        {
+            kmer_writer writer(kmers_file, score_format::log16, 16);
+            writer.write("node", k, 0.0f, first_kmers);
+        }
+        kmer_reader reader(kmers_file);
+        for (const auto& [kmer, score] : first_kmers)
+        {
+            const auto found = reader.find(0, kmer);
+            assert(found && std::isfinite(*found) && fabs(*found / score - 1) < 1e-3);
+        }
+    }
+
+    std::filesystem::remove(kmers_file);
 }
 
-struct bb_stats
+/// The maxima of a node over a budget of a few runs, merged from disk into a section
+void test_spill(size_t k)
 {
-    size_t k;
-    score_t omega;
-    std::vector<bb_return> returns;
-};
-
+    const score_t omega = 1.0;
+    auto node = make_test_node(k, omega);
+    dense_table node_table(k);
+    for (const auto& window : to_windows(node.data, k))
+    {
+        node_table.add_max(window, omega);
+    }
+    const auto kmers_file = (std::filesystem::temp_directory_path() / "xpas_algs_test_kmers.bin").string();
 
-void print_returns(const std::vector<bb_stats>& stats, const std::string& filename)
-{
-    std::cout << "Writing results: " << filename << "...";
+    spill_sink spilled(k, node.best.size() * sizeof(phylo_kmer), "");
+    for (const auto& window : to_windows(node.data, k))
+    {
+        branch_and_bound bb(window, k, omega);
+        bb.run(omega, spilled);
+    }
+    assert(node.best.size() < 4 || spilled.num_runs() > 1);
+
+    /// The same maxima from the dense table
+    spill_sink dense_spilled(k, node.best.size() * sizeof(phylo_kmer), "");
+    node_table.emit_max(dense_spilled);
+    assert(node.best.size() < 4 || dense_spilled.num_runs() > 1);
+    size_t num_dense_spilled = 0;
+    dense_spilled.for_each([&node, &num_dense_spilled](const phylo_kmer& kmer) {
+        assert(node.best.at(kmer.kmer) == kmer.score);
+        ++num_dense_spilled;
+    });
+    assert(num_dense_spilled == node.best.size());
 
-    std::ofstream file(filename);
-    for (const auto& [k, omega, stat]: stats)
     {
-        file << k << "," << omega << ",";
-        for (const auto& ret : stat)
-        {
-            switch (ret)
-            {
-                case bb_return::BAD_PREFIX:
-                    file << 0;
-                    break;
-                case bb_return::GOOD_KMER:
-                    file << 1;
-                    break;
-                case bb_return::GOOD_PRFIX:
-                    file << 2;
-                    break;
-            }
-            //file << ",";
-        }
-        file << std::endl;
+        kmer_writer writer(kmers_file, score_format::float32, 16);
+        writer.begin_section("node", k, omega);
+        spilled.for_each([&writer](const phylo_kmer& kmer) { writer.append(kmer.kmer, kmer.score); });
+        writer.end_section();
+    }
+    kmer_reader reader(kmers_file);
+    const auto stored = reader.read(0);
+    assert(stored.size() == node.best.size());
+    for (const auto& [kmer, score] : stored)
+    {
+        assert(node.best.at(kmer) == score);
     }
-    file.close();
 
-    std::cout << std::endl;
+    std::filesystem::remove(kmers_file);
 }
 
-std::tuple<std::vector<phylo_kmer>, run_stats> run_bb(const window& window, size_t k, float omega,
-                                                            const std::string& node_name)
+/// The best k-mer of the node
+phylo_kmer get_best_kmer(const test_node& node)
 {
-    branch_and_bound bb(window, k, omega);
-    auto begin = std::chrono::steady_clock::now();
-    bb.run(omega);
-    auto end = std::chrono::steady_clock::now();
-    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-    const auto stats = run_stats{
-                             algorithm::bb,
-                             bb.get_num_kmers(),
-                             time,
-                             k, omega,
-                             node_name,
-                             window.get_position()
-                         };
-    return { bb.get_result(), stats };
+    return *std::min_element(node.kmers.begin(), node.kmers.end(), kmer_score_comparator);
 }
 
-std::tuple<std::vector<phylo_kmer>, run_stats> run_dc(const window& window, size_t k, float omega,
-                                                      const std::string& node_name)
+/// A read made of the best k-mer of the node, twice, around an invalid character
+std::string make_test_read(const test_node& node, size_t k)
 {
-    divide_and_conquer dc(window, k, omega);
-    auto begin = std::chrono::steady_clock::now();
-    dc.run(omega);
-    auto end = std::chrono::steady_clock::now();
-    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-    const auto stats = run_stats{
-        algorithm::dc,
-        dc.get_num_kmers(),
-        time,
-        k, omega,
-        node_name,
-        window.get_position()
-    };
-    return { dc.get_result(), stats };
+    const auto kmer = decode_kmer(get_best_kmer(node).kmer, k);
+    return kmer + "N" + kmer;
 }
 
-std::tuple<std::vector<phylo_kmer>, run_stats> run_dccw(std::vector<phylo_kmer>& prefixes,
-                                                        const window& prev, const window& current, const window& next,
-                                                        size_t k, float omega,
-                                                        const std::string& node_name)
+/// A sequence of valid characters in both cases, U, gaps and ambiguous characters
+std::string make_test_sequence()
 {
-    score_t lookbehind = get_threshold(omega, k);
-    if (prev.get_position() < current.get_position())
+    const std::string symbols = "ACGTacgtUuNn-RY";
+    std::string sequence;
+    for (size_t i = 0; i < 100; ++i)
     {
-        lookbehind = prev.range_product(0, k / 2);;
+        sequence += symbols[(i * 7 + i / 5) % (i % 3 == 0 ? symbols.size() : 8)];
     }
-    else
+    return sequence;
+}
+
+/// The node maxima and the first window as two nodes of a database, with a node added twice
+void test_database(size_t k)
+{
+    const score_t omega = 1.0;
+    const auto node = make_test_node(k, omega);
+    const auto database_file = (std::filesystem::temp_directory_path() / "xpas_algs_test_kmers.db").string();
     {
-        prefixes.clear();
+        db_builder builder(k, omega);
+        builder.add("node", node.kmers);
+        builder.add("first", node.first_kmers);
+        const auto half = node.kmers.begin() + static_cast<std::ptrdiff_t>(node.kmers.size() / 2);
+        builder.add("node", { node.kmers.begin(), half });
+        builder.write(database_file);
     }
-    score_t lookahead = get_threshold(omega, k);
-    if (next.get_position() > current.get_position())
     {
-        lookahead = next.range_product(k / 2, k - k / 2);
+        const kmer_database database(database_file);
+        assert(database.get_k() == k && database.num_nodes() == 2 && database.num_codes() == node.best.size());
+        assert(database.node_name(0) == "node" && database.node_name(1) == "first");
+        map_t first_scores;
+        for (const auto& [kmer, score] : node.first_kmers)
+        {
+            first_scores[kmer] = score;
+        }
+        for (const auto& [kmer, score] : node.best)
+        {
+            const auto postings = database.find(kmer);
+            const bool in_first = first_scores.find(kmer) != first_scores.end();
+            assert(postings.size() == (in_first ? 2 : 1));
+            assert(postings.node(0) == 0 && fabs(postings.score(0) / score - 1) < 1e-3);
+            assert(!in_first || (postings.node(1) == 1 && fabs(postings.score(1) / first_scores[kmer] - 1) < 1e-3));
+        }
+        assert(database.find(~code_t{ 0 } >> 1).empty() && database.find(code_t{ 1 } << (k * bit_length)).empty());
     }
 
-    dccw dccw(current, prefixes, k, lookbehind, lookahead, omega);
-    auto begin = std::chrono::steady_clock::now();
-    dccw.run(omega);
-    auto end = std::chrono::steady_clock::now();
-    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-    prefixes = std::move(dccw.get_suffixes());
-
-    const auto stats = run_stats{
-        algorithm::dccw,
-        dccw.get_num_kmers(),
-        time,
-        k, omega,
+    /// A database whose tables point past each other is rejected when opened
+    {
+        std::string bytes;
+        {
+            std::ifstream in(database_file, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        const auto read_u64 = [&bytes](size_t offset) {
+            uint64_t value;
+            std::memcpy(&value, bytes.data() + offset, sizeof(value));
+            return value;
+        };
+        /// num_codes, num_postings and the offsets of the buckets, the directory and the postings in the header
+        const auto num_codes = read_u64(40);
+        const auto num_postings = read_u64(48);
+        const auto buckets_offset = read_u64(64);
+        const auto directory_offset = read_u64(72);
+        const auto postings_offset = read_u64(80);
+
+        const auto corrupted_file = database_file + ".corrupted";
+        const auto assert_rejected = [&](size_t offset, uint64_t value) {
+            auto corrupted = bytes;
+            std::memcpy(corrupted.data() + offset, &value, sizeof(value));
+            {
+                std::ofstream out(corrupted_file, std::ios::binary);
+                out.write(corrupted.data(), static_cast<std::streamsize>(corrupted.size()));
+            }
+            bool rejected = false;
+            try
+            {
+                kmer_database database(corrupted_file);
+            }
+            catch (const std::runtime_error&)
+            {
+                rejected = true;
+            }
+            assert(rejected);
+        };
+        assert_rejected(72, buckets_offset + sizeof(uint64_t));
+        assert_rejected(40, num_codes + (postings_offset - directory_offset) / sizeof(db_directory_entry));
+        assert_rejected(buckets_offset + sizeof(uint64_t), num_codes + 1);
+        assert_rejected(directory_offset + offsetof(db_directory_entry, begin), num_postings + 1);
+        std::filesystem::remove(corrupted_file);
+    }
+
+    /// With omega = 0, the scores of the database still come back
+    {
+        db_builder builder(k, 0.0f);
+        builder.add("first", node.first_kmers);
+        builder.write(database_file);
+    }
+    {
+        const kmer_database database(database_file);
+        assert(std::isfinite(database.get_log_threshold()) && database.get_log_threshold() < 0.0);
+        for (const auto& [kmer, score] : node.first_kmers)
+        {
+            const auto postings = database.find(kmer);
+            assert(postings.size() == 1 && fabs(postings.score(0) / score - 1) < 1e-3);
+            assert(fabs(postings.log_score(0) - std::log(score)) < 1e-3);
+        }
+    }
+    std::filesystem::remove(database_file);
+}
+
+/// The test read placed on the database of the node, and the default penalty at omega = 0
+void test_placement(size_t k)
+{
+    const score_t omega = 1.0;
+    const auto node = make_test_node(k, omega);
+    const auto database_file = (std::filesystem::temp_directory_path() / "xpas_algs_test_kmers.db").string();
+    {
+        db_builder builder(k, omega);
+        builder.add("node", node.kmers);
+        builder.add("first", node.first_kmers);
+        builder.write(database_file);
+    }
+    {
+        const kmer_database database(database_file);
+        placement_scorer scorer(database, 1);
+        const auto placements = scorer.score(make_test_read(node, k));
+        assert(placements.size() == 1);
+        const auto expected = 2 * std::log(static_cast<double>(get_best_kmer(node).score));
+        assert(placements[0].node == 0 && fabs(placements[0].score - expected) < 1e-2);
+        assert(scorer.score("N").empty());
+    }
+
+    /// With omega = 0, the penalty of the missing k-mers is still finite
+    {
+        db_builder builder(k, 0.0f);
+        builder.add("first", node.first_kmers);
+        builder.write(database_file);
+    }
+    {
+        const kmer_database database(database_file);
+        placement_scorer scorer(database, 1);
+        const auto placements = scorer.score(decode_kmer(node.first_kmers[0].kmer, k) + "A");
+        assert(placements.size() == 1 && std::isfinite(placements[0].score));
+        bool rejected = false;
+        try
+        {
+            placement_scorer(database, 1, -std::numeric_limits<double>::infinity());
+        }
+        catch (const std::runtime_error&)
+        {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    std::filesystem::remove(database_file);
+}
+
+/// The codes of the k-mers of the test read and sequence against the codes of their characters
+void test_encoder(size_t k)
+{
+    const score_t omega = 1.0;
+    const auto node = make_test_node(k, omega);
+    const auto best_kmer = get_best_kmer(node);
+    std::vector<code_t> codes;
+    std::vector<uint8_t> valid;
+    encode_kmers(make_test_read(node, k), k, codes, valid);
+    assert(codes.size() == k + 2 && valid[0] && valid[k + 1] && codes[0] == best_kmer.kmer);
+    assert(std::count(valid.begin(), valid.end(), 1) == 2 && codes[k + 1] == best_kmer.kmer);
+
+    /// Every window of a mixed sequence against the codes of its characters, one by one.
+    /// The long one is encoded in several blocks
+    const auto short_sequence = make_test_sequence();
+    for (const auto& sequence : { short_sequence, short_sequence + short_sequence + short_sequence })
+    {
+        encode_kmers(sequence, k, codes, valid);
+        assert(codes.size() == sequence.size() - k + 1 && valid.size() == codes.size());
+        for (size_t p = 0; p < codes.size(); ++p)
+        {
+            code_t expected_code = 0;
+            bool expected_valid = true;
+            for (size_t i = p; i < p + k; ++i)
+            {
+                const auto symbol = encode_char(sequence[i]);
+                expected_valid = expected_valid && symbol != invalid_symbol;
+                expected_code = (expected_code << bit_length) | symbol;
+            }
+            assert(static_cast<bool>(valid[p]) == expected_valid);
+            assert(!expected_valid || codes[p] == expected_code);
+        }
+    }
+}
+
+/// The reads scored straight from the matrix of the node
+void test_direct(size_t k)
+{
+    const score_t omega = 1.0;
+    const auto node = make_test_node(k, omega);
+    const auto read = make_test_read(node, k);
+    const auto expected = 2 * std::log(static_cast<double>(get_best_kmer(node).score));
+    const auto sequence = make_test_sequence();
+    std::vector<code_t> codes;
+    std::vector<uint8_t> valid;
+    encode_kmers(sequence, k, codes, valid);
+
+    /// The scorer and its cost model count the windows of to_windows
+    auto data = node.data;
+    auto narrow = ::matrix({ data.get_data().begin(), data.get_data().begin() + static_cast<std::ptrdiff_t>(k) });
+    for (auto* windowed : { &data, &narrow })
+    {
+        size_t num_windows = 0;
+        for (const auto& window : to_windows(*windowed, k))
+        {
+            (void)window;
+            ++num_windows;
+        }
+        assert(num_windows == to_windows::count(*windowed, k));
+    }
+    assert(to_windows::count(narrow, k) == 1 && to_windows::count(data, k) == data.width() - k);
+
+    /// The node scored straight from its matrix: the k-mers of the sequence are found iff they are
+    /// in the node maxima, up to the rounding of the logs at the threshold
+    direct_scorer direct(node.data, k, omega);
+    const auto log_threshold = std::log(get_threshold(omega, k));
+    for (size_t p = 0; p < codes.size(); ++p)
+    {
+        const auto found = node.best.find(codes[p]);
+        const auto log_score = direct.log_score(codes[p]);
+        if (!valid[p] || (found == node.best.end()) == !log_score)
+        {
+            assert(!valid[p] || !log_score || fabs(*log_score - std::log(found->second)) < 1e-3);
+            continue;
+        }
+        const auto score = (found == node.best.end()) ? std::exp(*log_score) : found->second;
+        assert(fabs(std::log(score) - log_threshold) < 1e-3);
+    }
+    assert(fabs(direct.score(read) - expected) < 1e-2);
+
+    work_stealing_pool pool(2);
+    const auto direct_scores = direct.score({ { "read", read }, { "sequence", sequence }, { "N", "N" } }, pool);
+    assert(direct_scores.size() == 3 && direct_scores[0] == direct.score(read));
+    assert(direct_scores[1] == direct.score(sequence) && direct_scores[2] == 0.0);
+}
+
+void test_suite()
+{
+    const size_t num_iter = 100;
+    const std::vector<size_t> k_values = { 6, 7, 8, 9 };
+
+    for (const auto k : k_values)
+    {
+        for (size_t i = 0; i < num_iter; ++i)
+        {
+            std::cout << "\rTesting k = " << k << ". " << i << " / " << num_iter << "..." << std::flush;
+            test_one(k, false);
+        }
+        std::cout << "\rTesting k = " << k << ". Done." << std::endl;
+    }
+
+    /// Storing and scoring the k-mers does not depend on the window, once per k is enough
+    for (const auto k : k_values)
+    {
+        std::cout << "Testing the storage of the k-mers, k = " << k << "..." << std::flush;
+        test_kmer_io(k);
+        test_spill(k);
+        test_database(k);
+        test_placement(k);
+        test_encoder(k);
+        test_direct(k);
+        std::cout << " Done." << std::endl;
+    }
+}
+
+
+void write_csv_header(std::ostream& file)
+{
+    file << "alg,num_kmers,time,k,omega,node,position" << std::endl;
+}
+
+void write_csv_rows(std::ostream& file, const std::vector<run_stats>& stats)
+{
+    for (const auto& stat: stats)
+    {
+        const auto& [alg, num_kmers, time, k, omega, node, position] = stat;
+
+        file << to_string(alg);
+        file << "," << num_kmers << "," << time << "," << k << "," << omega << "," << node << "," << position << '\n';
+    }
+}
+
+void print_as_csv(const std::vector<run_stats>& stats, const std::string& filename)
+{
+    std::cout << "Writing results: " << filename << "...";
+
+    std::ofstream file(filename);
+    write_csv_header(file);
+    write_csv_rows(file, stats);
+    file.close();
+
+    std::cout << std::endl;
+}
+
+struct bb_stats
+{
+    size_t k;
+    score_t omega;
+    std::vector<bb_return> returns;
+};
+
+
+void print_returns(const std::vector<bb_stats>& stats, const std::string& filename)
+{
+    std::cout << "Writing results: " << filename << "...";
+
+    std::ofstream file(filename);
+    for (const auto& [k, omega, stat]: stats)
+    {
+        file << k << "," << omega << ",";
+        for (const auto& ret : stat)
+        {
+            switch (ret)
+            {
+                case bb_return::BAD_PREFIX:
+                    file << 0;
+                    break;
+                case bb_return::GOOD_KMER:
+                    file << 1;
+                    break;
+                case bb_return::GOOD_PRFIX:
+                    file << 2;
+                    break;
+            }
+            //file << ",";
+        }
+        file << std::endl;
+    }
+    file.close();
+
+    std::cout << std::endl;
+}
+
+/// Runs branch-and-bound on the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_bb(const window& window, size_t k, float omega, const std::string& node_name, Sink& sink)
+{
+    branch_and_bound bb(window, k, omega);
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    bb.run(omega, counted);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::bb,
+        counted.get_count(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// Runs divide-and-conquer on the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_dc(const window& window, size_t k, float omega, const std::string& node_name, Sink& sink)
+{
+    divide_and_conquer dc(window, k, omega);
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    dc.run(omega, counted);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::dc,
+        counted.get_count(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// Counts the k-mers of the window that pass the threshold without enumerating them
+run_stats run_count(const window& window, size_t k, float omega, const std::string& node_name)
+{
+    dc_count count(window, k, omega);
+    auto begin = std::chrono::steady_clock::now();
+    count.run(omega);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::count,
+        count.get_num_kmers(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// Adds the scores of all the k-mers of the window to the best scores of the dense table
+run_stats run_dense(dense_table& table, const window& window, size_t k, float omega, const std::string& node_name)
+{
+    auto begin = std::chrono::steady_clock::now();
+    const auto num_kmers = table.add_max(window, omega);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::dense,
+        num_kmers,
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// Runs the hybrid of BB and DC on the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_hybrid(const window& window, size_t k, float omega, const std::string& node_name, Sink& sink)
+{
+    hybrid hybrid(window, k);
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    hybrid.run(omega, counted);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::hybrid,
+        counted.get_count(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// Runs top-N branch-and-bound on the window. The n best k-mers go to the sink
+template<typename Sink>
+run_stats run_topn(const window& window, size_t k, float omega, size_t n, const std::string& node_name, Sink& sink)
+{
+    top_n topn(window, k, n);
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    topn.run(omega, counted);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::topn,
+        counted.get_count(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// A streaming consumer that stops after the n best k-mers of the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_lazy(const window& window, size_t k, float omega, size_t n, const std::string& node_name, Sink& sink)
+{
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    lazy_bb lazy(window, k, omega);
+    for (const auto& [kmer, score] : lazy)
+    {
+        if (counted.get_count() == n)
+        {
+            break;
+        }
+        counted.emit(kmer, score);
+    }
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::lazy,
+        counted.get_count(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+/// Runs branch-and-bound once at the smallest omega and splits the result into the omega bands.
+/// Returns the stats for every omega; the time of the whole run goes to the smallest one
+std::vector<run_stats> run_multi_omega(omega_bands& bands, kmer_arena& arena, const window& window, size_t k,
+                                       const std::string& node_name)
+{
+    const auto omega = bands.min_omega();
+
+    branch_and_bound bb(window, k, omega);
+    auto begin = std::chrono::steady_clock::now();
+    arena.clear();
+    bb.run(omega, arena);
+    bands.clear();
+    for (const auto& kmer : arena)
+    {
+        bands.add(kmer);
+    }
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+
+    std::vector<run_stats> stats;
+    for (size_t b = 0; b < bands.size(); ++b)
+    {
+        stats.push_back({
+            algorithm::multi_omega,
+            bands.get_num_kmers(b),
+            (b == 0) ? time : 0,
+            k, bands.get_omegas()[b],
+            node_name,
+            window.get_position()
+        });
+    }
+    return stats;
+}
+
+/// Runs branch-and-bound once from the position for all the values of k that fit into the matrix.
+/// Returns the stats for every k; the time of the whole run goes to the smallest one
+std::vector<run_stats> run_multi_k(matrix& matrix, size_t position, const std::vector<size_t>& ks, float omega,
+                                   const std::string& node_name)
+{
+    /// The same windows as to_windows gives for every k
+    std::vector<size_t> fitting_ks;
+    for (const auto k : ks)
+    {
+        if (position + k < matrix.width())
+        {
+            fitting_ks.push_back(k);
+        }
+    }
+    if (fitting_ks.empty())
+    {
+        return {};
+    }
+
+    const auto window = ::window(matrix, position, *std::max_element(fitting_ks.begin(), fitting_ks.end()));
+    multi_k_bb bb(window, fitting_ks);
+    auto begin = std::chrono::steady_clock::now();
+    bb.run(omega);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+
+    std::vector<run_stats> stats;
+    for (size_t i = 0; i < bb.get_ks().size(); ++i)
+    {
+        stats.push_back({
+            algorithm::multi_k,
+            bb.get_num_kmers(i),
+            (i == 0) ? time : 0,
+            bb.get_ks()[i], omega,
+            node_name,
+            position
+        });
+    }
+    return stats;
+}
+
+/// Runs DCCW on the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_dccw(kmer_list& prefixes,
+                   const window& prev, const window& current, const window& next,
+                   size_t k, float omega,
+                   const std::string& node_name, Sink& sink)
+{
+    score_t lookbehind = get_threshold(omega, k);
+    if (prev.get_position() < current.get_position())
+    {
+        lookbehind = prev.range_product(0, k / 2);;
+    }
+    else
+    {
+        prefixes.clear();
+    }
+    score_t lookahead = get_threshold(omega, k);
+    if (next.get_position() > current.get_position())
+    {
+        lookahead = next.range_product(k / 2, k - k / 2);
+    }
+
+    dccw dccw(current, prefixes, k, lookbehind, lookahead, omega);
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    dccw.run(omega, counted);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    prefixes = std::move(dccw.get_suffixes());
+
+    return run_stats{
+        algorithm::dccw,
+        counted.get_count(),
+        time,
+        k, omega,
         node_name,
         current.get_position()
     };
-    return { dccw.get_result(), stats };
 }
 
-void test_random(const flags& flags,
-                 const std::vector<run_params>& parameters,
-                 size_t num_iter, const std::string& filename)
+/// Runs the algorithm chosen by the cost model on the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_auto(const cost_model& model, algorithm& last_alg,
+                   kmer_list& prefixes,
+                   const window& prev, const window& current, const window& next,
+                   size_t k, float omega,
+                   const std::string& node_name, Sink& sink)
+{
+    auto begin = std::chrono::steady_clock::now();
+    const auto alg = model.choose(get_features(current, k, omega));
+
+    /// DCCW can only reuse the suffixes of the previous window if it was computed by DCCW too
+    if (alg == algorithm::dccw && last_alg != algorithm::dccw)
+    {
+        prefixes.clear();
+    }
+    last_alg = alg;
+
+    run_stats stats;
+    switch (alg)
+    {
+        case algorithm::bb:
+            stats = run_bb(current, k, omega, node_name, sink);
+            break;
+        case algorithm::dc:
+            stats = run_dc(current, k, omega, node_name, sink);
+            break;
+        case algorithm::dccw:
+            stats = run_dccw(prefixes, prev, current, next, k, omega, node_name, sink);
+            break;
+        case algorithm::hybrid:
+            stats = run_hybrid(current, k, omega, node_name, sink);
+            break;
+        default:
+            throw std::runtime_error("The auto mode can not run " + to_string(alg));
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    stats.alg = algorithm::autotune;
+    stats.time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return stats;
+}
+
+/// Runs sliding branch-and-bound on the window. The k-mers go to the sink
+template<typename Sink>
+run_stats run_sbb(std::vector<phylo_kmer>& suffixes, const matrix& matrix, const window& window,
+                  size_t k, float omega, const std::string& node_name, Sink& sink)
+{
+    /// to_windows stops at the window that ends before the last column
+    score_t lookahead = 0.0f;
+    if (window.get_position() + 1 + k < matrix.width())
+    {
+        lookahead = window.max_at(k).second;
+    }
+
+    sliding_bb sbb(window, suffixes, k, lookahead);
+    counted_sink counted(sink);
+    auto begin = std::chrono::steady_clock::now();
+    sbb.run(omega, counted);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    return run_stats{
+        algorithm::sbb,
+        counted.get_count(),
+        time,
+        k, omega,
+        node_name,
+        window.get_position()
+    };
+}
+
+void test_random(const flags& flags, const run_options& options,
+                 const std::vector<run_params>& parameters,
+                 size_t num_iter, const std::string& filename)
+{
+    const auto node_name = "Random" + std::to_string(num_iter);
+
+    std::vector<run_stats> stats;
+
+    /// The k-mers are only counted
+    count_sink counter;
+
+    for (const auto& [k, omega] : parameters)
+    {
+        for (size_t i = 0; i < num_iter; ++i)
+        {
+            std::cout << "\r\tRunning for k = " << k << ", omega = " << omega << ". " << i << " / " << num_iter << "..." << std::flush;
+
+            auto matrix = generate(1000);
+
+            kmer_list prefixes;
+
+            for (const auto& [prev, window, next] : chain_windows(matrix, k))
+            {
+                if (flags.run_bb)
+                {
+                    stats.push_back(run_bb(window, k, omega, node_name, counter));
+                }
+
+                if (flags.run_dc)
+                {
+                    stats.push_back(run_dc(window, k, omega, node_name, counter));
+                }
+
+                if (flags.run_dccw)
+                {
+                    stats.push_back(run_dccw(prefixes, prev, window, next, k, omega, node_name, counter));
+                }
+
+                if (flags.run_hybrid)
+                {
+                    stats.push_back(run_hybrid(window, k, omega, node_name, counter));
+                }
+
+                if (flags.run_topn)
+                {
+                    stats.push_back(run_topn(window, k, omega, options.top_n, node_name, counter));
+                }
+
+                if (flags.run_lazy)
+                {
+                    stats.push_back(run_lazy(window, k, omega, options.top_n, node_name, counter));
+                }
+
+                if (flags.run_count)
+                {
+                    stats.push_back(run_count(window, k, omega, node_name));
+                }
+
+            }
+
+            /// SBB shares columns between consecutive windows, it needs a stride-1 scan
+            if (flags.run_sbb)
+            {
+                std::vector<phylo_kmer> suffixes;
+                for (const auto& window : to_windows(matrix, k))
+                {
+                    stats.push_back(run_sbb(suffixes, matrix, window, k, omega, node_name, counter));
+                }
+            }
+        }
+        std::cout << "\r\tRunning for k = " << k << ", omega = " << omega << ". Done." << std::endl;
+    }
+
+    print_as_csv(stats, filename);
+    //print_returns(bb_stats, "returns.txt");
+}
+
+
+/// The best score of every k-mer over a range of windows of a node, for one pair of k and omega
+struct kmer_section
+{
+    std::string node;
+    size_t k;
+    score_t omega;
+    std::vector<phylo_kmer> kmers;
+
+    // set instead of kmers if the k-mers went over the memory budget
+    std::unique_ptr<spill_sink> spilled;
+};
+
+/// Everything computed for a range of windows
+struct result_batch
+{
+    std::vector<run_stats> stats;
+    std::vector<tuning_sample> samples;
+
+    // filled if the k-mers are stored
+    std::vector<kmer_section> sections;
+};
+
+/// Whether most of the k-mers of the windows of the matrix that start in [begin, end) pass the threshold,
+/// so that their best scores are cheaper to keep in a dense table
+bool prefer_dense(matrix& matrix, size_t k, score_t omega, size_t begin, size_t end, double min_fill_ratio)
+{
+    if (k > max_dense_k)
+    {
+        return false;
+    }
+
+    const size_estimator estimator;
+    double num_kmers = 0.0;
+    size_t num_windows = 0;
+    for (const auto& window : to_windows(matrix, k))
+    {
+        if (begin <= window.get_position() && window.get_position() < end)
+        {
+            num_kmers += estimator.estimate(window, k, omega).estimate;
+            ++num_windows;
+        }
+    }
+    return num_windows > 0 && num_kmers >= min_fill_ratio * std::pow(sigma, k) * static_cast<double>(num_windows);
+}
+
+/// Runs the algorithms of the flags for the windows of the matrix that start in [begin, end).
+/// The algorithms that share data between consecutive windows start over at the first window of the range
+void run_range(const flags& flags, const run_options& options, const cost_model& model,
+               const std::vector<run_params>& parameters, matrix& matrix, const std::string& node_name,
+               size_t begin, size_t end, result_batch& batch)
+{
+    auto& stats = batch.stats;
+    auto& samples = batch.samples;
+    const bool calibrate = !options.calibrate_file.empty();
+    const bool store_kmers = !options.kmers_file.empty();
+    const auto in_range = [begin, end](size_t position) { return begin <= position && position < end; };
+
+    /// The k-mers of the first of BB, DC and DCCW are stored if needed, the others are only counted
+    const bool store_bb = store_kmers && flags.run_bb;
+    const bool store_dc = store_kmers && !flags.run_bb && flags.run_dc;
+    const bool store_dccw = store_kmers && !flags.run_bb && !flags.run_dc && flags.run_dccw;
+    count_sink counter;
+
+    /// Reused by the windows of the range for the k-mers that have to be materialized
+    kmer_arena arena(options.huge_pages);
+
+    for (const auto& [k, omega] : parameters)
+    {
+
+        kmer_list prefixes;
+        kmer_list auto_prefixes;
+        algorithm last_alg = algorithm::autotune;
+
+        /// A k-mer of the node gets the best score over all the windows.
+        /// If most of the k-mers pass, the scores go to a dense table instead and BB, DC and DCCW only count.
+        /// The table is charged to the memory budget, and not used if it would take more than half of it
+        const auto budget = options.memory_budget;
+        const bool dense = store_kmers && prefer_dense(matrix, k, omega, begin, end, options.dense_fill_ratio)
+            && (budget == 0 || 2 * dense_table::memory_size(k) <= budget);
+        std::optional<dense_table> table;
+        if (dense)
+        {
+            table.emplace(k);
+        }
+        spill_sink best(k, (dense && budget > 0) ? budget - dense_table::memory_size(k) : budget, options.spill_dir);
+        for (const auto& [prev, window, next] : chain_windows(matrix, k))
+        //for (const auto& window : to_windows(matrix, k))
+        {
+            if (!in_range(window.get_position()))
+            {
+                continue;
+            }
+
+            /// The previous window of the chain was not computed, there is nothing to reuse
+            if (prev.get_position() < begin)
+            {
+                prefixes.clear();
+                auto_prefixes.clear();
+                last_alg = algorithm::autotune;
+            }
+
+            const auto first_stat = stats.size();
+
+            if (dense)
+            {
+                stats.push_back(run_dense(*table, window, k, omega, node_name));
+            }
+
+            if (flags.run_bb)
+            {
+                stats.push_back(store_bb && !dense
+                                ? run_bb(window, k, omega, node_name, best)
+                                : run_bb(window, k, omega, node_name, counter));
+            }
+
+            if (flags.run_dc)
+            {
+                stats.push_back(store_dc && !dense
+                                ? run_dc(window, k, omega, node_name, best)
+                                : run_dc(window, k, omega, node_name, counter));
+            }
+
+            if (flags.run_dccw)
+            {
+                stats.push_back(store_dccw && !dense
+                                ? run_dccw(prefixes, prev, window, next, k, omega, node_name, best)
+                                : run_dccw(prefixes, prev, window, next, k, omega, node_name, counter));
+            }
+
+            if (flags.run_hybrid)
+            {
+                stats.push_back(run_hybrid(window, k, omega, node_name, counter));
+            }
+
+            if (flags.run_topn)
+            {
+                stats.push_back(run_topn(window, k, omega, options.top_n, node_name, counter));
+            }
+
+            if (flags.run_lazy)
+            {
+                stats.push_back(run_lazy(window, k, omega, options.top_n, node_name, counter));
+            }
+
+            if (flags.run_count)
+            {
+                stats.push_back(run_count(window, k, omega, node_name));
+            }
+
+            if (flags.run_auto)
+            {
+                stats.push_back(run_auto(model, last_alg, auto_prefixes, prev, window, next,
+                                         k, omega, node_name, counter));
+            }
+
+            if (calibrate)
+            {
+                const auto features = get_features(window, k, omega);
+                for (size_t i = first_stat; i < stats.size(); ++i)
+                {
+                    if (stats[i].alg != algorithm::autotune)
+                    {
+                        samples.push_back({ stats[i].alg, features, stats[i].time });
+                    }
+                }
+            }
+        }
+
+        if (store_kmers)
+        {
+            /// The maxima of the dense table go through the spill sink too, so that they stay within the budget
+            if (dense)
+            {
+                table->emit_max(best);
+                table.reset();
+            }
+
+            kmer_section section{ node_name, k, omega, {}, nullptr };
+            if (best.num_runs() > 0)
+            {
+                section.spilled = std::make_unique<spill_sink>(std::move(best));
+            }
+            else
+            {
+                section.kmers = best.get_result();
+            }
+            batch.sections.push_back(std::move(section));
+        }
+
+        /// SBB shares columns between consecutive windows, it needs a stride-1 scan
+        if (flags.run_sbb)
+        {
+            std::vector<phylo_kmer> suffixes;
+            for (const auto& window : to_windows(matrix, k))
+            {
+                if (in_range(window.get_position()))
+                {
+                    stats.push_back(run_sbb(suffixes, matrix, window, k, omega, node_name, counter));
+                }
+            }
+        }
+    }
+
+    /// One enumeration per k for all the omega values of it
+    if (flags.run_multi_omega)
+    {
+        for (const auto& [k, omegas] : group_by_k(parameters))
+        {
+            omega_bands bands(omegas, k);
+            for (const auto& [prev, window, next] : chain_windows(matrix, k))
+            {
+                if (in_range(window.get_position()))
+                {
+                    const auto window_stats = run_multi_omega(bands, arena, window, k, node_name);
+                    stats.insert(stats.end(), window_stats.begin(), window_stats.end());
+                }
+            }
+        }
+    }
+
+    /// One enumeration per position for all the values of k with the same omega
+    if (flags.run_multi_k)
+    {
+        for (const auto& [omega, ks] : group_by_omega(parameters))
+        {
+            for (size_t position = begin; position < std::min(end, matrix.width()); ++position)
+            {
+                const auto window_stats = run_multi_k(matrix, position, ks, omega, node_name);
+                stats.insert(stats.end(), window_stats.begin(), window_stats.end());
+            }
+        }
+    }
+}
+
+/// The expected cost of the windows starting at every position of the matrix, summed over the parameters.
+/// The cost of a window is its estimated number of k-mers over the threshold
+std::vector<double> estimate_costs(matrix& matrix, const std::vector<run_params>& parameters)
 {
-    const auto node_name = "Random" + std::to_string(num_iter);
+    const size_estimator estimator;
+    std::vector<double> costs(matrix.width(), 1.0);
+    for (const auto& [k, omega] : parameters)
+    {
+        for (const auto& window : to_windows(matrix, k))
+        {
+            costs[window.get_position()] += estimator.estimate(window, k, omega).estimate;
+        }
+    }
+    return costs;
+}
 
-    std::vector<run_stats> stats;
+/// A range of windows of a node computed by one task of the parallel driver
+struct range_task
+{
+    const std::string* node_name;
+    matrix* node_matrix;
+    size_t begin;
+    size_t end;
+    double cost;
+};
+
+/// Splits the nodes into ranges of windows of about the same expected cost and orders them
+/// by the cost, the most expensive first. Small nodes go as a whole, big nodes are split.
+/// A few ranges per worker are enough to balance the load, and the ranges stay long enough
+/// for the algorithms that share data between consecutive windows
+std::vector<range_task> plan_ranges(std::unordered_map<std::string, matrix>& sample,
+                                    const std::vector<run_params>& parameters, size_t num_workers)
+{
+    const size_t ranges_per_worker = 8;
+
+    std::vector<std::vector<double>> node_costs;
+    double total_cost = 0.0;
+    for (auto& [node_name, matrix] : sample)
+    {
+        node_costs.push_back(estimate_costs(matrix, parameters));
+        total_cost += std::accumulate(node_costs.back().begin(), node_costs.back().end(), 0.0);
+    }
+    const auto range_cost = total_cost / static_cast<double>(num_workers * ranges_per_worker);
+
+    std::vector<range_task> tasks;
+    size_t node_i = 0;
+    for (auto& [node_name, matrix] : sample)
+    {
+        const auto& costs = node_costs[node_i++];
 
-    /// for debugging
-    std::vector<phylo_kmer> bb_result;
-    std::vector<phylo_kmer> dc_result;
-    std::vector<phylo_kmer> dccw_result;
-    (void)bb_result; (void)dc_result; (void)dccw_result;
+        size_t begin = 0;
+        double cost = 0.0;
+        for (size_t position = 0; position < costs.size(); ++position)
+        {
+            cost += costs[position];
+            if (cost >= range_cost || position + 1 == costs.size())
+            {
+                tasks.push_back({ &node_name, &matrix, begin, position + 1, cost });
+                begin = position + 1;
+                cost = 0.0;
+            }
+        }
+    }
 
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [](const range_task& a, const range_task& b) { return a.cost > b.cost; });
+    return tasks;
+}
 
+/// Builds the databases from the stored k-mers. With many pairs of k and omega,
+/// the name of a database gets the suffix .k<k>_o<omega>
+void build_databases(const run_options& options, const std::vector<run_params>& parameters)
+{
+    kmer_reader reader(options.kmers_file);
     for (const auto& [k, omega] : parameters)
     {
-        for (size_t i = 0; i < num_iter; ++i)
+        auto filename = options.database_file;
+        if (parameters.size() > 1)
         {
-            std::cout << "\r\tRunning for k = " << k << ", omega = " << omega << ". " << i << " / " << num_iter << "..." << std::flush;
+            std::ostringstream suffix;
+            suffix << ".k" << k << "_o" << omega;
+            filename += suffix.str();
+        }
 
-            auto matrix = generate(1000);
+        db_builder builder(k, omega);
+        builder.add(reader);
+        builder.write(filename);
+        std::cout << "Written the database: " << filename << std::endl;
+    }
+}
 
-            std::vector<phylo_kmer> prefixes;
+/// Writes the k-mers of the batch, a section per pair of k and omega
+void write_kmers(kmer_writer& writer, result_batch& batch)
+{
+    for (auto& section : batch.sections)
+    {
+        if (section.spilled)
+        {
+            /// The runs on disk are merged straight into the file
+            writer.begin_section(section.node, section.k, section.omega);
+            section.spilled->for_each([&writer](const phylo_kmer& kmer) { writer.append(kmer.kmer, kmer.score); });
+            writer.end_section();
+        }
+        else
+        {
+            writer.write(section.node, section.k, section.omega, std::move(section.kmers));
+        }
+    }
+    batch.sections.clear();
+}
 
-            for (const auto& [prev, window, next] : chain_windows(matrix, k))
+/// Runs the nodes on a work-stealing pool of options.num_threads threads.
+/// Every worker writes into its own buffers, they are merged at the end
+void run_parallel(const flags& flags, const run_options& options, const cost_model& model,
+                  const std::vector<run_params>& parameters, std::unordered_map<std::string, matrix>& sample,
+                  std::vector<run_stats>& stats, std::vector<tuning_sample>& samples, kmer_writer* writer)
+{
+    /// Padded to keep the workers from sharing cache lines
+    struct alignas(64) worker_buffers
+    {
+        std::vector<run_stats> stats;
+        std::vector<tuning_sample> samples;
+    };
+
+    work_stealing_pool pool(options.num_threads);
+    const auto tasks = plan_ranges(sample, parameters, pool.size());
+    std::vector<worker_buffers> buffers(pool.size());
+    std::mutex writer_mutex;
+    for (const auto& task : tasks)
+    {
+        pool.submit([&, task](size_t worker) {
+            result_batch batch;
+            run_range(flags, options, model, parameters, *task.node_matrix, *task.node_name, task.begin, task.end,
+                      batch);
+
+            auto& buffer = buffers[worker];
+            buffer.stats.insert(buffer.stats.end(), batch.stats.begin(), batch.stats.end());
+            buffer.samples.insert(buffer.samples.end(), batch.samples.begin(), batch.samples.end());
+            if (writer)
             {
-                if (flags.run_bb)
+                std::lock_guard lock(writer_mutex);
+                write_kmers(*writer, batch);
+            }
+        });
+    }
+
+    std::cout << "\tRunning " << tasks.size() << " ranges on " << pool.size() << " threads..." << std::flush;
+    pool.run();
+    std::cout << " Done." << std::endl;
+
+    for (auto& buffer : buffers)
+    {
+        stats.insert(stats.end(), buffer.stats.begin(), buffer.stats.end());
+        samples.insert(samples.end(), buffer.samples.begin(), buffer.samples.end());
+    }
+}
+
+/// A node read by the pipeline. It is shared by the ranges of windows of the node
+/// and freed when the last of them is computed
+struct node_item
+{
+    std::string name;
+    ::matrix data;
+};
+
+struct range_item
+{
+    std::shared_ptr<node_item> node;
+    size_t begin;
+    size_t end;
+};
+
+/// Streams the nodes through the stages connected by bounded queues:
+/// a reader thread parses the file node by node, the windowers split the ghost nodes into ranges of windows,
+/// the enumerators compute the ranges, and the calling thread writes the results as they come.
+/// Full queues block the stages before them, so only a few nodes are in memory at once
+void run_pipeline(const flags& flags, const run_options& options, const cost_model& model,
+                  const std::vector<run_params>& parameters, const std::string& input,
+                  const std::vector<std::string>& ghost_ids, const std::string& output,
+                  std::vector<tuning_sample>& samples, kmer_writer* writer)
+{
+    const std::unordered_set<std::string> ghosts(ghost_ids.begin(), ghost_ids.end());
+
+    bounded_queue<std::shared_ptr<node_item>> nodes(options.queue_capacity);
+    bounded_queue<range_item> ranges(options.queue_capacity * options.num_threads);
+    bounded_queue<result_batch> results(options.queue_capacity * options.num_threads);
+
+    /// The first error stops the pipeline: the closed queues make the producers throw and the consumers drain
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    const auto stop = [&]() {
+        {
+            std::lock_guard lock(error_mutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        nodes.close();
+        ranges.close();
+        results.close();
+    };
+
+    /// Runs a stage on the threads. The last thread of the stage to finish closes its output queue
+    std::vector<std::thread> threads;
+    const auto start_stage = [&](size_t num_threads, auto body, auto& output_queue) {
+        auto remaining = std::make_shared<std::atomic<size_t>>(num_threads);
+        auto* queue = &output_queue;
+        for (size_t i = 0; i < num_threads; ++i)
+        {
+            threads.emplace_back([&stop, body, remaining, queue]() {
+                try
                 {
-                    const auto& [result, stat] = run_bb(window, k, omega, node_name);
-                    stats.push_back(stat);
-                    bb_result = result;
+                    body();
                 }
-
-                if (flags.run_dc)
+                catch (...)
                 {
-                    const auto& [result, stat] = run_dc(window, k, omega, node_name);
-                    stats.push_back(stat);
-                    dc_result = result;
+                    stop();
                 }
 
-                if (flags.run_dccw)
+                if (remaining->fetch_sub(1) == 1)
                 {
-                    const auto& [result, stat] = run_dccw(prefixes, prev, window, next, k, omega, node_name);
-                    stats.push_back(stat);
-                    dccw_result = result;
+                    queue->close();
                 }
+            });
+        }
+    };
 
-                //assert_equal(bb_result, dc_result);
-                //assert_equal(dc_result, dccw_result);
+    std::cout << "Running the pipeline: " << options.num_windowers << " windower(s), "
+              << options.num_threads << " enumerator(s)..." << std::flush;
+
+    start_stage(1, [&]() {
+        raxmlng_reader reader(input);
+        while (auto node = reader.read_next())
+        {
+            if (ghosts.find(node->first) != ghosts.end())
+            {
+                nodes.push(std::make_shared<node_item>(node_item{ std::move(node->first), std::move(node->second) }));
             }
         }
-        std::cout << "\r\tRunning for k = " << k << ", omega = " << omega << ". Done." << std::endl;
+    }, nodes);
+
+    start_stage(options.num_windowers, [&]() {
+        while (auto node = nodes.pop())
+        {
+            const auto width = (*node)->data.width();
+            for (size_t begin = 0; begin < width; begin += options.range_size)
+            {
+                ranges.push({ *node, begin, std::min(begin + options.range_size, width) });
+            }
+        }
+    }, ranges);
+
+    start_stage(options.num_threads, [&]() {
+        while (auto range = ranges.pop())
+        {
+            result_batch batch;
+            run_range(flags, options, model, parameters, range->node->data, range->node->name,
+                      range->begin, range->end, batch);
+            results.push(std::move(batch));
+        }
+    }, results);
+
+    try
+    {
+        std::ofstream file(output);
+        write_csv_header(file);
+        while (auto batch = results.pop())
+        {
+            write_csv_rows(file, batch->stats);
+            samples.insert(samples.end(), batch->samples.begin(), batch->samples.end());
+            if (writer)
+            {
+                write_kmers(*writer, *batch);
+            }
+        }
+        file.close();
+    }
+    catch (...)
+    {
+        stop();
     }
 
-    print_as_csv(stats, filename);
-    //print_returns(bb_stats, "returns.txt");
-}
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
 
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    std::cout << " Done." << std::endl;
+}
 
 std::vector<std::string> get_ghost_ids(const std::string& filename)
 {
@@ -585,83 +2180,102 @@ std::vector<std::string> get_ghost_ids(const std::string& filename)
 
 
 
-void test_data(const flags& flags,
+void test_data(const flags& flags, const run_options& options,
                const std::vector<run_params>& parameters, const std::string& input,
                const std::string& ghost_ids_file, const std::string& output)
 {
+    cost_model model;
+    if (flags.run_auto)
+    {
+        model = cost_model::load(options.model_file);
+    }
+    const bool calibrate = !options.calibrate_file.empty();
+    std::vector<tuning_sample> samples;
+
     const auto ghost_ids = get_ghost_ids(ghost_ids_file);
 
-    raxmlng_reader reader(input);
-    auto matrices = reader.read();
+    std::unique_ptr<kmer_writer> writer;
+    if (!options.kmers_file.empty())
+    {
+        writer = std::make_unique<kmer_writer>(options.kmers_file,
+                                               options.quantize ? score_format::log16 : score_format::float32);
+    }
 
-    std::unordered_map<std::string, matrix> sample;
-    for (const auto& [k, v] : matrices)
+    /// Streaming: the nodes are computed and written while the file is still being read
+    if (options.pipeline)
     {
-        if (const auto& it = std::find(ghost_ids.begin(), ghost_ids.end(), k); it != ghost_ids.end())
-        {
-            sample[k] = v;
-        }
+        run_pipeline(flags, options, model, parameters, input, ghost_ids, output, samples, writer.get());
     }
+    else
+    {
+        raxmlng_reader reader(input);
+        auto matrices = reader.read();
 
-    /// for debugging
-    std::vector<phylo_kmer> bb_result;
-    std::vector<phylo_kmer> dc_result;
-    std::vector<phylo_kmer> dccw_result;
-    (void)bb_result; (void)dc_result; (void)dccw_result;
+        std::unordered_map<std::string, matrix> sample;
+        for (const auto& [k, v] : matrices)
+        {
+            if (const auto& it = std::find(ghost_ids.begin(), ghost_ids.end(), k); it != ghost_ids.end())
+            {
+                sample[k] = v;
+            }
+        }
 
-    std::cout << "Num matrices: " << sample.size() << std::endl;
+        std::cout << "Num matrices: " << sample.size() << std::endl;
 
-    std::vector<run_stats> stats;
-    size_t node_i = 0;
-    for (auto& [node_name, matrix] : sample)
-    {
-        if (node_i % 1 == 0)
+        std::vector<run_stats> stats;
+        if (options.num_threads > 1)
         {
-            std::cout << "\r\tRunning for node " << node_name << ", " << node_i << " / " << sample.size() << "..." << std::flush;
+            run_parallel(flags, options, model, parameters, sample, stats, samples, writer.get());
         }
-
-        for (const auto& [k, omega] : parameters)
+        else
         {
-
-            std::vector<phylo_kmer> prefixes;
-            for (const auto& [prev, window, next] : chain_windows(matrix, k))
-            //for (const auto& window : to_windows(matrix, k))
+            size_t node_i = 0;
+            for (auto& [node_name, matrix] : sample)
             {
-                if (flags.run_bb)
+                if (node_i % 1 == 0)
                 {
-                    const auto& [result, stat] = run_bb(window, k, omega, node_name);
-                    stats.push_back(stat);
-                    bb_result = result;
+                    std::cout << "\r\tRunning for node " << node_name << ", " << node_i << " / " << sample.size() << "..." << std::flush;
                 }
 
-                if (flags.run_dc)
+                result_batch batch;
+                run_range(flags, options, model, parameters, matrix, node_name, 0, matrix.width(), batch);
+                stats.insert(stats.end(), batch.stats.begin(), batch.stats.end());
+                samples.insert(samples.end(), batch.samples.begin(), batch.samples.end());
+                if (writer)
                 {
-                    const auto& [result, stat] = run_dc(window, k, omega, node_name);
-                    stats.push_back(stat);
-                    dc_result = result;
+                    write_kmers(*writer, batch);
                 }
 
-                if (flags.run_dccw)
+                if (node_i % 1 == 0)
                 {
-                    const auto& [result, stat] = run_dccw(prefixes, prev, window, next, k, omega, node_name);
-                    stats.push_back(stat);
-                    dccw_result = result;
+                    std::cout << "\r\tRunning for node " << node_name << ", " << node_i << " / " << sample.size() << ". Done.\n"
+                              << std::flush;
                 }
-
-                //assert_equal(bb_result, dc_result);
-                //assert_equal(dc_result, dccw_result);
+                node_i++;
             }
         }
 
-        if (node_i % 1 == 0)
+        print_as_csv(stats, output);
+    }
+
+    if (writer)
+    {
+        writer->close();
+        std::cout << "Written k-mers: " << options.kmers_file << ", " << writer->bytes_written() << " bytes"
+                  << std::endl;
+
+        if (!options.database_file.empty())
         {
-            std::cout << "\r\tRunning for node " << node_name << ", " << node_i << " / " << sample.size() << ". Done.\n"
-                      << std::flush;
+            build_databases(options, parameters);
         }
-        node_i++;
     }
 
-    print_as_csv(stats, output);
+    if (calibrate)
+    {
+        std::cout << "Writing the cost model: " << options.calibrate_file << "...";
+        cost_model::fit(samples).save(options.calibrate_file);
+        std::cout << std::endl;
+    }
 }
 
 int main(int argc, char** argv)
@@ -686,33 +2300,159 @@ int main(int argc, char** argv)
 
     flags alg_flags = { true, true, true };
 
-    if (argc > 2)
+    /// Named options can go anywhere after the program name
+    run_options options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if ((arg == "--model" || arg == "--calibrate") && i + 1 < argc)
+        {
+            (arg == "--model" ? options.model_file : options.calibrate_file) = argv[++i];
+        }
+        else if (arg == "--top" && i + 1 < argc)
+        {
+            options.top_n = std::stoul(argv[++i]);
+        }
+        else if (arg == "--pipeline")
+        {
+            options.pipeline = true;
+        }
+        else if (arg == "--kmers" && i + 1 < argc)
+        {
+            options.kmers_file = argv[++i];
+        }
+        else if (arg == "--database" && i + 1 < argc)
+        {
+            options.database_file = argv[++i];
+        }
+        else if (arg == "--quantize")
+        {
+            options.quantize = true;
+        }
+        else if (arg == "--huge-pages")
+        {
+            options.huge_pages = true;
+        }
+        else if (arg == "--dense-ratio" && i + 1 < argc)
+        {
+            options.dense_fill_ratio = std::stod(argv[++i]);
+        }
+        else if (arg == "--memory-budget" && i + 1 < argc)
+        {
+            /// In megabytes
+            options.memory_budget = std::stoul(argv[++i]) << 20;
+        }
+        else if (arg == "--spill-dir" && i + 1 < argc)
+        {
+            options.spill_dir = argv[++i];
+        }
+        else if (arg == "--windowers" && i + 1 < argc)
+        {
+            options.num_windowers = std::max(std::stoul(argv[++i]), 1ul);
+        }
+        else if (arg == "--queue" && i + 1 < argc)
+        {
+            options.queue_capacity = std::max(std::stoul(argv[++i]), 1ul);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            /// 0 means all the hardware threads
+            options.num_threads = std::stoul(argv[++i]);
+            if (options.num_threads == 0)
+            {
+                options.num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    /// The width of the codes is fixed by the build
+    for (const auto& [k, omega] : parameters)
+    {
+        if (k > max_k)
+        {
+            std::cerr << "k = " << k << " does not fit into " << 8 * sizeof(code_t) << "-bit codes, "
+                      << "build with a larger KMER_CODE_BITS" << std::endl;
+            return 1;
+        }
+    }
+
+    /// Without input files, the arguments are the algorithm flags of the random matrices
+    const bool random_flags = std::all_of(args.begin(), args.end(),
+                                          [](const std::string& arg) { return arg == "0" || arg == "1"; });
+    if (args.size() > 1 && !random_flags)
     {
-        if (argc != 7)
+        /// The algorithm flags go between the input files and the output file.
+        /// The trailing ones can be omitted and default to 0
+        const auto num_flags = args.size() > 3 ? args.size() - 3 : 0;
+        if (args.size() < 6 || num_flags > flag_order.size())
         {
             std::cout << "Usage:\n\t"
-                << argv[0] << "\n\n or \n\n\t"
-                << argv[0] << " <RAxML-NG output file> <Ghost ID file> 0/1[run BB] 0/1[run DC] 0/1[run DCCW] OUTPUT_FILE" << std::endl;
+                << argv[0] << " [0/1[run BB] 0/1[run DC] 0/1[run DCCW] ...]\n\n or \n\n\t"
+                << argv[0] << " <RAxML-NG output file> <Ghost ID file> 0/1[run BB] 0/1[run DC] 0/1[run DCCW] "
+                              "[0/1[run SBB] 0/1[run HYBRID] 0/1[run AUTO] 0/1[run TOPN] 0/1[run LAZY] "
+                              "0/1[run BB for all omegas at once] 0/1[run BB for all k at once] 0/1[run COUNT]] "
+                              "[--model MODEL_FILE] [--calibrate MODEL_FILE] [--top N] [--threads N] "
+                              "[--pipeline [--windowers N] [--queue N]] "
+                              "[--kmers KMER_FILE [--quantize] [--database DB_FILE]] "
+                              "[--huge-pages] [--dense-ratio R] [--memory-budget MB [--spill-dir DIR]] "
+                              "OUTPUT_FILE" << std::endl;
+            return 1;
+        }
+        const std::string& filename = args[0];
+        const std::string& ghost_ids_file = args[1];
+        flags data_flags = {};
+        for (size_t i = 0; i < num_flags; ++i)
+        {
+            data_flags.*flag_order[i] = static_cast<bool>(std::stoi(args[2 + i]));
+        }
+        const std::string& output_file = args.back();
+
+        if (data_flags.run_auto && options.model_file.empty())
+        {
+            std::cerr << "The auto mode requires a cost model: --model MODEL_FILE" << std::endl;
             return 1;
         }
-        std::string filename = argv[1];
-        std::string ghost_ids_file = argv[2];
-        bool run_bb = static_cast<bool>(std::stoi(argv[3]));
-        bool run_dc = static_cast<bool>(std::stoi(argv[4]));
-        bool run_dccw = static_cast<bool>(std::stoi(argv[5]));
-        std::string output_file = argv[6];
 
-        if (std::filesystem::exists(output_file))
+        if (!options.kmers_file.empty() && !(data_flags.run_bb || data_flags.run_dc || data_flags.run_dccw))
         {
-            std::cerr << "File exists: " << output_file << std::endl;
+            std::cerr << "Storing k-mers requires BB, DC or DCCW" << std::endl;
             return 1;
         }
 
-        test_data({ run_bb, run_dc, run_dccw }, parameters, filename, ghost_ids_file, output_file);
+        for (const auto& file : { output_file, options.kmers_file })
+        {
+            if (!file.empty() && std::filesystem::exists(file))
+            {
+                std::cerr << "File exists: " << file << std::endl;
+                return 1;
+            }
+        }
+
+        test_data(data_flags, options, parameters, filename, ghost_ids_file, output_file);
     }
     else
     {
-        test_random(alg_flags, parameters, 1000, std::string(std::tmpnam(nullptr)) + ".csv");
+        if (!random_flags || args.size() > flag_order.size())
+        {
+            std::cerr << "Expected at most " << flag_order.size() << " 0/1 algorithm flags for the random matrices"
+                      << std::endl;
+            return 1;
+        }
+        /// As with the input files, the trailing flags can be omitted and default to 0
+        if (!args.empty())
+        {
+            alg_flags = {};
+        }
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            alg_flags.*flag_order[i] = static_cast<bool>(std::stoi(args[i]));
+        }
+        test_random(alg_flags, options, parameters, 1000, std::string(std::tmpnam(nullptr)) + ".csv");
     }
 
     return 0;
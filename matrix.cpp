@@ -200,7 +200,7 @@ score_t window::range_product(size_t start_pos, size_t len) const
 
 matrix::column window::get_column(size_t j) const
 {
-    return _matrix.get_column(j);
+    return _matrix.get_column(_start_pos + j);
 }
 
 std::pair<size_t, score_t> window::max_at(size_t column) const
@@ -355,6 +355,15 @@ to_windows::to_windows(matrix& matrix, size_t kmer_size)
     : _matrix{ matrix }, _kmer_size{ kmer_size }//, _start_pos{ 0 }
 {}
 
+size_t to_windows::count(const matrix& matrix, size_t kmer_size) noexcept
+{
+    if (matrix.width() < kmer_size)
+    {
+        return 0;
+    }
+    return std::max(matrix.width() - kmer_size, size_t{ 1 });
+}
+
 to_windows::const_iterator to_windows::begin() const
 {
     return { _matrix, _kmer_size };
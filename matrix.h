@@ -169,6 +169,11 @@ public:
     to_windows& operator=(to_windows&&) = delete;
     ~to_windows() noexcept = default;
 
+    /// The number of windows of the iteration: all the starting positions but the last one,
+    /// and the only window when the matrix is exactly k columns wide
+    [[nodiscard]]
+    static size_t count(const matrix& matrix, size_t kmer_size) noexcept;
+
     [[nodiscard]]
     const_iterator begin() const;
 
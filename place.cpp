@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "place.h"
+#include "encode.h"
+
+/// The number of reads in a task of the pool
+static const size_t reads_per_task = 64;
+
+query_reader::query_reader(std::istream& in)
+    : _in(in)
+{}
+
+bool query_reader::read(std::vector<query>& batch, size_t max_size)
+{
+    batch.clear();
+    std::string line;
+    while (batch.size() < max_size)
+    {
+        std::string header = std::move(_next_header);
+        _next_header.clear();
+        while (header.empty() && std::getline(_in, line))
+        {
+            if (!line.empty() && (line[0] == '>' || line[0] == '@'))
+            {
+                header = line;
+            }
+        }
+        if (header.empty())
+        {
+            break;
+        }
+
+        query q;
+        q.name = header.substr(1, header.find_first_of(" \t\r") - 1);
+        if (header[0] == '@')
+        {
+            // FASTQ: the sequence, the separator and the qualities
+            if (!std::getline(_in, q.sequence))
+            {
+                throw std::runtime_error("Truncated FASTQ record: " + q.name);
+            }
+            std::getline(_in, line);
+            std::getline(_in, line);
+        }
+        else
+        {
+            // FASTA: the sequence can span many lines, up to the next header
+            while (std::getline(_in, line))
+            {
+                if (!line.empty() && line[0] == '>')
+                {
+                    _next_header = line;
+                    break;
+                }
+                q.sequence += line;
+            }
+        }
+
+        if (!q.sequence.empty() && q.sequence.back() == '\r')
+        {
+            q.sequence.pop_back();
+        }
+        batch.push_back(std::move(q));
+    }
+    return !batch.empty();
+}
+
+placement_scorer::placement_scorer(const kmer_database& database, size_t top)
+    : placement_scorer(database, top, database.get_log_threshold())
+{}
+
+placement_scorer::placement_scorer(const kmer_database& database, size_t top, double penalty)
+    : _database(database), _top(top), _penalty(penalty)
+{
+    if (_top == 0)
+    {
+        throw std::runtime_error("The number of placements per read must be positive");
+    }
+    if (!std::isfinite(_penalty))
+    {
+        throw std::runtime_error("The penalty of the missing k-mers must be finite");
+    }
+}
+
+std::vector<std::vector<placement>> placement_scorer::score(const std::vector<query>& batch,
+                                                            work_stealing_pool& pool)
+{
+    _workspaces.resize(pool.size());
+
+    std::vector<std::vector<placement>> result(batch.size());
+    for (size_t begin = 0; begin < batch.size(); begin += reads_per_task)
+    {
+        const auto end = std::min(begin + reads_per_task, batch.size());
+        pool.submit([this, &batch, &result, begin, end](size_t worker) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                score(batch[i].sequence, _workspaces[worker], result[i]);
+            }
+        });
+    }
+    pool.run();
+    return result;
+}
+
+std::vector<placement> placement_scorer::score(const std::string& sequence)
+{
+    _workspaces.resize(std::max(_workspaces.size(), size_t{ 1 }));
+    std::vector<placement> result;
+    score(sequence, _workspaces[0], result);
+    return result;
+}
+
+void placement_scorer::score(const std::string& sequence, workspace& space, std::vector<placement>& result) const
+{
+    result.clear();
+    encode_kmers(sequence, _database.get_k(), space.codes, space.valid);
+
+    // Only the valid k-mers are looked up
+    size_t num_kmers = 0;
+    for (size_t i = 0; i < space.codes.size(); ++i)
+    {
+        if (space.valid[i])
+        {
+            space.codes[num_kmers++] = space.codes[i];
+        }
+    }
+    if (num_kmers == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < num_kmers; ++i)
+    {
+        __builtin_prefetch(_database.bucket_address(space.codes[i]));
+    }
+
+    space.postings.clear();
+    for (size_t i = 0; i < num_kmers; ++i)
+    {
+        const auto postings = _database.find(space.codes[i]);
+        if (!postings.empty())
+        {
+            __builtin_prefetch(postings.data());
+            space.postings.push_back(postings);
+        }
+    }
+
+    space.node_scores.resize(_database.num_nodes(), 0.0);
+    space.is_touched.resize(_database.num_nodes(), 0);
+    for (const auto& postings : space.postings)
+    {
+        for (size_t j = 0; j < postings.size(); ++j)
+        {
+            const auto node = postings.node(j);
+            if (!space.is_touched[node])
+            {
+                space.is_touched[node] = 1;
+                space.touched.push_back(node);
+            }
+            space.node_scores[node] += postings.log_score(j) - _penalty;
+        }
+    }
+
+    // Every node starts with the penalty for all the k-mers
+    const auto base = static_cast<double>(num_kmers) * _penalty;
+    for (const auto node : space.touched)
+    {
+        result.push_back({ node, base + space.node_scores[node] });
+        space.node_scores[node] = 0.0;
+        space.is_touched[node] = 0;
+    }
+    space.touched.clear();
+
+    const auto by_score = [](const placement& a, const placement& b) {
+        return a.score > b.score || (a.score == b.score && a.node < b.node);
+    };
+    if (result.size() > _top)
+    {
+        std::partial_sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(_top), result.end(), by_score);
+        result.resize(_top);
+    }
+    else
+    {
+        std::sort(result.begin(), result.end(), by_score);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef XPAS_ALGS_PLACE_H
+#define XPAS_ALGS_PLACE_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "database.h"
+#include "pool.h"
+
+/// A query read
+struct query
+{
+    std::string name;
+    std::string sequence;
+};
+
+/// Reads queries from FASTA or FASTQ, a batch at a time
+class query_reader
+{
+public:
+    explicit query_reader(std::istream& in);
+
+    /// Reads up to max_size queries into the batch. Returns false when there is nothing left
+    bool read(std::vector<query>& batch, size_t max_size);
+
+private:
+    std::istream& _in;
+
+    /// The header line of the next FASTA record, already read
+    std::string _next_header;
+};
+
+/// A node and the log-score of a read there
+struct placement
+{
+    uint32_t node;
+    double score;
+};
+
+/// Scores reads against a phylo-k-mer database. The score of a read at a node is the sum over the k-mers of the read
+/// of their log-scores at the node, with a penalty for the k-mers that are not stored for the node.
+/// By default, the penalty is the log of the threshold, the best score such a k-mer can have,
+/// floored for a zero threshold like the quantized scores of the database.
+///
+/// The k-mers of a read are looked up in groups: the buckets of all of them are prefetched,
+/// then the directory entries are found and their postings prefetched, then the postings are added up.
+/// That keeps many cache misses in flight instead of one per lookup
+class placement_scorer
+{
+public:
+    placement_scorer(const kmer_database& database, size_t top);
+    placement_scorer(const kmer_database& database, size_t top, double penalty);
+
+    /// The top nodes of the reads, best first. The reads are split between the workers of the pool
+    std::vector<std::vector<placement>> score(const std::vector<query>& batch, work_stealing_pool& pool);
+
+    /// The top nodes of a read, best first. Reads with no valid k-mer have no placement
+    std::vector<placement> score(const std::string& sequence);
+
+private:
+    /// The buffers of a thread, reused across reads
+    struct workspace
+    {
+        std::vector<code_t> codes;
+        std::vector<uint8_t> valid;
+        std::vector<posting_list> postings;
+
+        /// The sum of (log-score - penalty) of every node, and the nodes touched by the current read
+        std::vector<double> node_scores;
+        std::vector<uint8_t> is_touched;
+        std::vector<uint32_t> touched;
+    };
+
+    void score(const std::string& sequence, workspace& space, std::vector<placement>& result) const;
+
+    const kmer_database& _database;
+    size_t _top;
+    double _penalty;
+
+    std::vector<workspace> _workspaces;
+};
+
+#endif //XPAS_ALGS_PLACE_H
@@ -0,0 +1,103 @@
+#include <stdexcept>
+#include <thread>
+
+#include "pool.h"
+
+work_stealing_pool::work_stealing_pool(size_t num_workers)
+    : _next_queue(0)
+{
+    if (num_workers == 0)
+    {
+        throw std::runtime_error("The pool needs at least one worker");
+    }
+
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        _queues.push_back(std::make_unique<task_queue>());
+    }
+}
+
+void work_stealing_pool::submit(task t)
+{
+    _queues[_next_queue]->tasks.push_back(std::move(t));
+    _next_queue = (_next_queue + 1) % _queues.size();
+}
+
+void work_stealing_pool::run()
+{
+    _error = nullptr;
+
+    /// The calling thread is the worker 0
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < _queues.size(); ++i)
+    {
+        threads.emplace_back(&work_stealing_pool::work, this, i);
+    }
+    work(0);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    _next_queue = 0;
+
+    if (_error)
+    {
+        std::rethrow_exception(_error);
+    }
+}
+
+size_t work_stealing_pool::size() const
+{
+    return _queues.size();
+}
+
+bool work_stealing_pool::pop(size_t worker, task& t)
+{
+    auto& queue = *_queues[worker];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    t = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool work_stealing_pool::steal(size_t thief, task& t)
+{
+    for (size_t i = 1; i < _queues.size(); ++i)
+    {
+        auto& queue = *_queues[(thief + i) % _queues.size()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            t = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_stealing_pool::work(size_t worker)
+{
+    /// No tasks are submitted during the run, so a worker that finds all the deques empty is done
+    task t;
+    while (pop(worker, t) || steal(worker, t))
+    {
+        try
+        {
+            t(worker);
+        }
+        catch (...)
+        {
+            std::lock_guard lock(_error_mutex);
+            if (!_error)
+            {
+                _error = std::current_exception();
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef XPAS_ALGS_POOL_H
+#define XPAS_ALGS_POOL_H
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// A fixed set of worker threads with a task deque each. Tasks are dealt to the deques
+/// round-robin in the order of submission. A worker takes the tasks from the front of its own deque,
+/// and when it runs out, it steals from the back of the others.
+///
+/// Submit the most expensive tasks first: every worker starts with the big ones,
+/// and the thieves pick up the small ones at the end.
+class work_stealing_pool
+{
+public:
+    /// A task gets the index of the worker that runs it, to write into per-worker buffers
+    using task = std::function<void(size_t worker)>;
+
+    explicit work_stealing_pool(size_t num_workers);
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool(work_stealing_pool&&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(work_stealing_pool&&) = delete;
+    ~work_stealing_pool() noexcept = default;
+
+    /// Adds a task. Not thread-safe, tasks can not be submitted while the pool is running
+    void submit(task t);
+
+    /// Runs all the submitted tasks and waits for them to finish.
+    /// Rethrows the first exception thrown by a task
+    void run();
+
+    size_t size() const;
+
+private:
+    struct task_queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    bool pop(size_t worker, task& t);
+
+    bool steal(size_t thief, task& t);
+
+    void work(size_t worker);
+
+    std::vector<std::unique_ptr<task_queue>> _queues;
+
+    size_t _next_queue;
+
+    std::mutex _error_mutex;
+    std::exception_ptr _error;
+};
+
+#endif //XPAS_ALGS_POOL_H
@@ -0,0 +1,181 @@
+#ifndef XPAS_ALGS_QUEUE_H
+#define XPAS_ALGS_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+/// A bounded lock-free multi-producer multi-consumer queue (D. Vyukov's algorithm).
+/// Every cell has a sequence number that tells whether it is ready to be written or read
+/// at the current lap, so producers and consumers only contend on their own position counter.
+///
+/// The blocking push and pop wait while the queue is full or empty, which applies backpressure
+/// to the producers. A closed queue rejects pushes and lets the consumers drain it.
+template<typename T>
+class bounded_queue
+{
+public:
+    /// The capacity is rounded up to a power of two
+    explicit bounded_queue(size_t capacity)
+        : _enqueue_pos(0)
+        , _dequeue_pos(0)
+        , _closed(false)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        _mask = size - 1;
+
+        _cells = std::make_unique<cell[]>(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue(bounded_queue&&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+    bounded_queue& operator=(bounded_queue&&) = delete;
+    ~bounded_queue() noexcept = default;
+
+    /// Moves the value into the queue if there is space
+    bool try_push(T& value)
+    {
+        auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+        cell* target;
+        while (true)
+        {
+            target = &_cells[pos & _mask];
+            const auto sequence = target->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            // the cell was not read yet at the previous lap: the queue is full
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        target->data = std::move(value);
+        target->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Moves the front value out of the queue if there is one
+    bool try_pop(T& value)
+    {
+        auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+        cell* target;
+        while (true)
+        {
+            target = &_cells[pos & _mask];
+            const auto sequence = target->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            // the cell was not written yet at this lap: the queue is empty
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(target->data);
+        target->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Waits until there is space. Throws if the queue is closed
+    void push(T value)
+    {
+        for (size_t attempt = 0; !try_push(value); ++attempt)
+        {
+            if (_closed.load(std::memory_order_acquire))
+            {
+                throw std::runtime_error("Push to a closed queue");
+            }
+            backoff(attempt);
+        }
+    }
+
+    /// Waits until there is a value. Returns nothing if the queue is closed and empty
+    std::optional<T> pop()
+    {
+        T value;
+        for (size_t attempt = 0; !try_pop(value); ++attempt)
+        {
+            if (_closed.load(std::memory_order_acquire))
+            {
+                // a value could be pushed between the failed pop and the close
+                if (try_pop(value))
+                {
+                    break;
+                }
+                return std::nullopt;
+            }
+            backoff(attempt);
+        }
+        return std::optional<T>(std::move(value));
+    }
+
+    /// No more values are coming. The waiting consumers return when the queue is empty
+    void close()
+    {
+        _closed.store(true, std::memory_order_release);
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    /// Spins for a short wait, then sleeps not to burn a core if the other side is slow
+    static void backoff(size_t attempt)
+    {
+        if (attempt < 64)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    alignas(64) std::atomic<size_t> _enqueue_pos;
+    alignas(64) std::atomic<size_t> _dequeue_pos;
+    alignas(64) std::atomic<bool> _closed;
+
+    std::unique_ptr<cell[]> _cells;
+    size_t _mask;
+};
+
+#endif //XPAS_ALGS_QUEUE_H
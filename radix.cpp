@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <array>
+#include <thread>
+
+#include "radix.h"
+
+/// The width of a digit of the radix sort and the number of its values
+static const size_t digit_bits = 8;
+static const size_t num_buckets = size_t{ 1 } << digit_bits;
+
+/// Smaller inputs are sorted by one thread, starting the threads would cost more than it saves
+static const size_t min_parallel_size = size_t{ 1 } << 16;
+
+/// The smallest number of pending k-mers merged at once by sorted_max_sink
+static const size_t min_merge_size = size_t{ 1 } << 12;
+
+using histogram = std::array<size_t, num_buckets>;
+
+static size_t get_digit(code_t code, size_t shift)
+{
+    return static_cast<size_t>(code >> shift) & (num_buckets - 1);
+}
+
+/// Runs f(t) for t in [0, num_threads), the first one in the calling thread
+template<typename Function>
+static void parallel_for(size_t num_threads, const Function& f)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (size_t t = 1; t < num_threads; ++t)
+    {
+        threads.emplace_back(f, t);
+    }
+    f(0);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void radix_sort(std::vector<phylo_kmer>& kmers, size_t k, std::vector<phylo_kmer>& buffer, size_t num_threads)
+{
+    const auto size = kmers.size();
+    if (size < 2)
+    {
+        return;
+    }
+
+    num_threads = std::max(size_t{ 1 }, std::min(num_threads, size / min_parallel_size));
+    const auto chunk_size = (size + num_threads - 1) / num_threads;
+    const auto num_bits = std::min(k * bit_length, 8 * sizeof(code_t));
+
+    buffer.resize(size);
+    std::vector<histogram> counts(num_threads);
+    for (size_t shift = 0; shift < num_bits; shift += digit_bits)
+    {
+        parallel_for(num_threads, [&](size_t t) {
+            auto& count = counts[t];
+            count.fill(0);
+            const auto end = std::min(size, (t + 1) * chunk_size);
+            for (size_t i = t * chunk_size; i < end; ++i)
+            {
+                ++count[get_digit(kmers[i].kmer, shift)];
+            }
+        });
+
+        // The digit is the same for all the k-mers, the pass would not move anything
+        const auto first_digit = get_digit(kmers[0].kmer, shift);
+        size_t num_first = 0;
+        for (const auto& count : counts)
+        {
+            num_first += count[first_digit];
+        }
+        if (num_first == size)
+        {
+            continue;
+        }
+
+        // A chunk writes the k-mers of a digit after the ones of the smaller digits,
+        // and after the ones of the same digit from the previous chunks. That keeps the sort stable
+        size_t offset = 0;
+        for (size_t d = 0; d < num_buckets; ++d)
+        {
+            for (auto& count : counts)
+            {
+                const auto n = count[d];
+                count[d] = offset;
+                offset += n;
+            }
+        }
+
+        parallel_for(num_threads, [&](size_t t) {
+            auto& position = counts[t];
+            const auto end = std::min(size, (t + 1) * chunk_size);
+            for (size_t i = t * chunk_size; i < end; ++i)
+            {
+                buffer[position[get_digit(kmers[i].kmer, shift)]++] = kmers[i];
+            }
+        });
+        kmers.swap(buffer);
+    }
+}
+
+void radix_sort(std::vector<phylo_kmer>& kmers, size_t k, size_t num_threads)
+{
+    std::vector<phylo_kmer> buffer;
+    radix_sort(kmers, k, buffer, num_threads);
+}
+
+void merge_max(std::vector<phylo_kmer>& kmers)
+{
+    if (kmers.empty())
+    {
+        return;
+    }
+
+    size_t last = 0;
+    for (size_t i = 1; i < kmers.size(); ++i)
+    {
+        if (kmers[i].kmer == kmers[last].kmer)
+        {
+            kmers[last].score = std::max(kmers[last].score, kmers[i].score);
+        }
+        else
+        {
+            kmers[++last] = kmers[i];
+        }
+    }
+    kmers.resize(last + 1);
+}
+
+void merge_max(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer>& b, std::vector<phylo_kmer>& result)
+{
+    result.clear();
+    result.reserve(a.size() + b.size());
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        if (a[i].kmer < b[j].kmer)
+        {
+            result.push_back(a[i++]);
+        }
+        else if (b[j].kmer < a[i].kmer)
+        {
+            result.push_back(b[j++]);
+        }
+        else
+        {
+            result.push_back({ a[i].kmer, std::max(a[i].score, b[j].score) });
+            ++i;
+            ++j;
+        }
+    }
+    result.insert(result.end(), a.begin() + static_cast<std::ptrdiff_t>(i), a.end());
+    result.insert(result.end(), b.begin() + static_cast<std::ptrdiff_t>(j), b.end());
+}
+
+sorted_max_sink::sorted_max_sink(size_t k)
+    : _k(k), _merge_size(min_merge_size)
+{}
+
+const std::vector<phylo_kmer>& sorted_max_sink::get_result()
+{
+    if (!_pending.empty())
+    {
+        merge();
+    }
+    return _kmers;
+}
+
+void sorted_max_sink::clear()
+{
+    _kmers.clear();
+    _pending.clear();
+    _merge_size = min_merge_size;
+}
+
+void sorted_max_sink::merge()
+{
+    radix_sort(_pending, _k, _buffer);
+    merge_max(_pending);
+
+    if (_kmers.empty())
+    {
+        _kmers.swap(_pending);
+    }
+    else
+    {
+        merge_max(_kmers, _pending, _buffer);
+        _kmers.swap(_buffer);
+    }
+    _pending.clear();
+
+    // The next merge waits until as many k-mers are pending as there are merged ones
+    _merge_size = std::max(min_merge_size, _kmers.size());
+}
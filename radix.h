@@ -0,0 +1,66 @@
+#ifndef XPAS_ALGS_RADIX_H
+#define XPAS_ALGS_RADIX_H
+
+#include <vector>
+#include "common.h"
+
+/// Sorts k-mers by code with an LSD radix sort over 8-bit digits. Only the k * bit_length low bits
+/// of a code are significant, so it takes ceil(k * bit_length / 8) passes (k / 4 for DNA),
+/// and the passes where all the k-mers have the same digit are skipped.
+///
+/// The sort is stable: the k-mers with the same code keep their order.
+/// Every pass scatters between the k-mers and the buffer, which are swapped at the end if needed,
+/// so the buffer can be reused across calls to avoid allocations.
+/// With more than one thread, the k-mers are split into chunks that are counted and scattered in parallel
+void radix_sort(std::vector<phylo_kmer>& kmers, size_t k, std::vector<phylo_kmer>& buffer, size_t num_threads = 1);
+
+void radix_sort(std::vector<phylo_kmer>& kmers, size_t k, size_t num_threads = 1);
+
+/// Collapses the runs of equal codes of k-mers sorted by code into one k-mer with the best score
+void merge_max(std::vector<phylo_kmer>& kmers);
+
+/// Merges two runs of k-mers sorted by code, with unique codes, into result in one pass.
+/// The k-mers found in both keep the best score
+void merge_max(const std::vector<phylo_kmer>& a, const std::vector<phylo_kmer>& b, std::vector<phylo_kmer>& result);
+
+/// Keeps the best score of every k-mer like max_sink, but in a vector sorted by code instead of a map.
+/// The k-mers are appended to a pending buffer. When it gets as big as the merged k-mers,
+/// it is radix sorted, collapsed and merged into them in a linear pass,
+/// so every k-mer is sorted and merged an amortized constant number of times. Not thread-safe
+class sorted_max_sink
+{
+public:
+    explicit sorted_max_sink(size_t k);
+
+    void emit(code_t kmer, score_t score)
+    {
+        _pending.push_back({ kmer, score });
+        if (_pending.size() >= _merge_size)
+        {
+            merge();
+        }
+    }
+
+    /// The k-mers sorted by code, with unique codes and their best scores
+    const std::vector<phylo_kmer>& get_result();
+
+    /// The number of k-mers held, the pending ones may repeat codes
+    size_t size() const
+    {
+        return _kmers.size() + _pending.size();
+    }
+
+    void clear();
+
+private:
+    void merge();
+
+    size_t _k;
+    size_t _merge_size;
+
+    std::vector<phylo_kmer> _kmers;
+    std::vector<phylo_kmer> _pending;
+    std::vector<phylo_kmer> _buffer;
+};
+
+#endif //XPAS_ALGS_RADIX_H
@@ -0,0 +1,149 @@
+#ifndef XPAS_ALGS_SINK_H
+#define XPAS_ALGS_SINK_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "table.h"
+#include "kmer_io.h"
+
+/// Sinks receive the k-mers from the engines as they are found: sink.emit(code, score).
+/// The engines are templated on the sink type, so emit is inlined into their inner loops
+/// and nothing is materialized unless the sink does it.
+
+/// Counts the k-mers without storing them
+class count_sink
+{
+public:
+    void emit(code_t, score_t)
+    {
+        ++_count;
+    }
+
+    size_t get_count() const
+    {
+        return _count;
+    }
+
+private:
+    size_t _count = 0;
+};
+
+/// Appends the k-mers to a vector
+class vector_sink
+{
+public:
+    explicit vector_sink(std::vector<phylo_kmer>& kmers)
+        : _kmers(kmers)
+    {}
+
+    void emit(code_t kmer, score_t score)
+    {
+        _kmers.push_back({ kmer, score });
+    }
+
+private:
+    std::vector<phylo_kmer>& _kmers;
+};
+
+/// Keeps the best score of every k-mer in a map, e.g. over the windows of a node. Not thread-safe
+class max_sink
+{
+public:
+    explicit max_sink(map_t& best_scores)
+        : _best_scores(best_scores)
+    {}
+
+    void emit(code_t kmer, score_t score)
+    {
+        auto& best = _best_scores[kmer];
+        best = std::max(best, score);
+    }
+
+private:
+    map_t& _best_scores;
+};
+
+/// Keeps the best score of every k-mer in a concurrent table. Many threads can emit into the same table
+class table_sink
+{
+public:
+    explicit table_sink(kmer_table& table)
+        : _table(table)
+    {}
+
+    void emit(code_t kmer, score_t score)
+    {
+        _table.insert_max(kmer, score);
+    }
+
+private:
+    kmer_table& _table;
+};
+
+/// The histogram of the log-scores between log(threshold) and 0 in bins of equal width.
+/// The log-threshold is the one of the quantized scores, finite for omega = 0
+class histogram_sink
+{
+public:
+    histogram_sink(score_t omega, size_t k, size_t num_bins)
+        : _log_threshold(get_log_threshold(omega, k))
+        , _bins(num_bins, 0)
+    {}
+
+    void emit(code_t, score_t score)
+    {
+        const auto x = (std::log(static_cast<double>(score)) - _log_threshold) / -_log_threshold;
+
+        // The scores under the floor of the threshold, and NaN, go to the first bin
+        size_t bin = 0;
+        if (x >= 1.0)
+        {
+            bin = _bins.size() - 1;
+        }
+        else if (x > 0.0)
+        {
+            bin = std::min(static_cast<size_t>(x * static_cast<double>(_bins.size())), _bins.size() - 1);
+        }
+        ++_bins[bin];
+    }
+
+    /// The bin b counts the k-mers with log(score) in log(threshold) * (1 - [b, b + 1) / num_bins)
+    const std::vector<size_t>& get_bins() const
+    {
+        return _bins;
+    }
+
+private:
+    double _log_threshold;
+    std::vector<size_t> _bins;
+};
+
+/// Counts the k-mers passed to another sink
+template<typename Sink>
+class counted_sink
+{
+public:
+    explicit counted_sink(Sink& sink)
+        : _sink(sink)
+    {}
+
+    void emit(code_t kmer, score_t score)
+    {
+        ++_count;
+        _sink.emit(kmer, score);
+    }
+
+    size_t get_count() const
+    {
+        return _count;
+    }
+
+private:
+    Sink& _sink;
+    size_t _count = 0;
+};
+
+#endif //XPAS_ALGS_SINK_H
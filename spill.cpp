@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#include "spill.h"
+
+/// The smallest number of k-mers read at once from a run
+static const size_t min_block_size = 4096;
+
+/// The k-mers in memory take about a quarter of the budget. The rest is for the buffers of sorting
+/// and merging, and for the slack of the vectors that grow geometrically
+static const size_t budget_per_kmer = 4 * sizeof(phylo_kmer);
+
+/// A new file name in the directory. Unique within the process, and most likely across processes
+static std::string temporary_file(const std::string& directory)
+{
+    static std::atomic<size_t> counter = 0;
+    const auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    const auto name = "xpas_algs_spill_" + std::to_string(stamp) + "_" + std::to_string(counter++) + ".bin";
+    const auto path = directory.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(directory);
+    return (path / name).string();
+}
+
+spill_sink::spill_sink(size_t k, size_t memory_budget, std::string directory)
+    : _memory_budget(memory_budget)
+    , _directory(std::move(directory))
+    , _max_size(memory_budget == 0 ? SIZE_MAX : std::max(memory_budget / budget_per_kmer, size_t{ 1 }))
+    , _kmers(k)
+{}
+
+spill_sink::~spill_sink() noexcept
+{
+    for (const auto& run : _runs)
+    {
+        std::remove(run.c_str());
+    }
+}
+
+size_t spill_sink::num_runs() const
+{
+    return _runs.size();
+}
+
+const std::vector<phylo_kmer>& spill_sink::get_result()
+{
+    if (!_runs.empty())
+    {
+        throw std::runtime_error("The k-mers were spilled to disk, they can only be merged with for_each");
+    }
+    return _kmers.get_result();
+}
+
+void spill_sink::spill()
+{
+    const auto& kmers = _kmers.get_result();
+    if (kmers.empty())
+    {
+        return;
+    }
+
+    auto filename = temporary_file(_directory);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    _runs.push_back(std::move(filename));
+
+    file.write(reinterpret_cast<const char*>(kmers.data()),
+               static_cast<std::streamsize>(kmers.size() * sizeof(phylo_kmer)));
+    if (!file)
+    {
+        throw std::runtime_error("Could not write " + _runs.back());
+    }
+    _kmers.clear();
+}
+
+spill_sink::run_merger::run_merger(const std::vector<std::string>& runs, size_t memory_budget)
+    : _block_size(std::max(memory_budget / (runs.size() * sizeof(phylo_kmer)), min_block_size))
+{
+    for (const auto& filename : runs)
+    {
+        auto r = std::make_unique<run>();
+        r->file.open(filename, std::ios::binary);
+        if (!r->file)
+        {
+            throw std::runtime_error("Could not open " + filename);
+        }
+        r->position = 0;
+        _runs.push_back(std::move(r));
+    }
+
+    for (size_t i = 0; i < _runs.size(); ++i)
+    {
+        if (current(*_runs[i]))
+        {
+            _heap.push({ _runs[i]->block[0].kmer, i });
+        }
+    }
+}
+
+bool spill_sink::run_merger::next(phylo_kmer& kmer)
+{
+    if (_heap.empty())
+    {
+        return false;
+    }
+
+    const auto code = _heap.top().first;
+    kmer = { code, 0.0f };
+
+    // A code is in at most one block of every run
+    while (!_heap.empty() && _heap.top().first == code)
+    {
+        const auto i = _heap.top().second;
+        _heap.pop();
+
+        auto& r = *_runs[i];
+        kmer.score = std::max(kmer.score, r.block[r.position].score);
+        ++r.position;
+        if (current(r))
+        {
+            _heap.push({ r.block[r.position].kmer, i });
+        }
+    }
+    return true;
+}
+
+bool spill_sink::run_merger::current(run& r)
+{
+    if (r.position < r.block.size())
+    {
+        return true;
+    }
+
+    r.block.resize(_block_size);
+    r.file.read(reinterpret_cast<char*>(r.block.data()),
+                static_cast<std::streamsize>(_block_size * sizeof(phylo_kmer)));
+    const auto num_bytes = static_cast<size_t>(r.file.gcount());
+    if (num_bytes % sizeof(phylo_kmer) != 0)
+    {
+        throw std::runtime_error("A spilled run of k-mers is truncated");
+    }
+    r.block.resize(num_bytes / sizeof(phylo_kmer));
+    r.position = 0;
+    return !r.block.empty();
+}
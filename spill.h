@@ -0,0 +1,110 @@
+#ifndef XPAS_ALGS_SPILL_H
+#define XPAS_ALGS_SPILL_H
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "radix.h"
+
+/// Keeps the best score of every k-mer like sorted_max_sink, within a memory budget.
+/// When the k-mers in memory reach the budget, they are sorted, collapsed and written as a run
+/// to a temporary file, and the memory is reused. The runs are merged at the end, reading them in blocks,
+/// so the k-mers of a node can outgrow the memory as long as they fit on disk.
+/// A budget of zero means no limit: nothing is ever spilled. Not thread-safe
+class spill_sink
+{
+public:
+    /// The temporary files go to the directory, or to the system temporary directory if it is empty
+    spill_sink(size_t k, size_t memory_budget, std::string directory = "");
+    spill_sink(const spill_sink&) = delete;
+    spill_sink(spill_sink&&) = default;
+    spill_sink& operator=(const spill_sink&) = delete;
+    spill_sink& operator=(spill_sink&&) = delete;
+    ~spill_sink() noexcept;
+
+    void emit(code_t kmer, score_t score)
+    {
+        _kmers.emit(kmer, score);
+        if (_kmers.size() >= _max_size)
+        {
+            spill();
+        }
+    }
+
+    /// The number of runs written to disk
+    size_t num_runs() const;
+
+    /// The k-mers, if nothing was spilled
+    const std::vector<phylo_kmer>& get_result();
+
+    /// Calls f(kmer) for every k-mer with its best score in the order of codes,
+    /// merging the runs on disk with the k-mers in memory
+    template<typename F>
+    void for_each(F&& f)
+    {
+        if (_runs.empty())
+        {
+            for (const auto& kmer : _kmers.get_result())
+            {
+                f(kmer);
+            }
+            return;
+        }
+
+        spill();
+        run_merger merger(_runs, _memory_budget);
+        phylo_kmer kmer{};
+        while (merger.next(kmer))
+        {
+            f(kmer);
+        }
+    }
+
+private:
+    /// Merges sorted runs of unique k-mers, reading them in blocks.
+    /// The k-mers of the same code in different runs are merged into one with the best score
+    class run_merger
+    {
+    public:
+        run_merger(const std::vector<std::string>& runs, size_t memory_budget);
+
+        bool next(phylo_kmer& kmer);
+
+    private:
+        struct run
+        {
+            std::ifstream file;
+            std::vector<phylo_kmer> block;
+            size_t position;
+        };
+
+        /// The current k-mer of the run, reading the next block if needed
+        bool current(run& r);
+
+        std::vector<std::unique_ptr<run>> _runs;
+        size_t _block_size;
+
+        /// The current code of every run that is not over, and the index of the run
+        using entry = std::pair<code_t, size_t>;
+        std::priority_queue<entry, std::vector<entry>, std::greater<entry>> _heap;
+    };
+
+    /// Writes the k-mers in memory as a run and forgets them
+    void spill();
+
+    size_t _memory_budget;
+    std::string _directory;
+
+    /// The number of k-mers kept in memory before a spill
+    size_t _max_size;
+
+    sorted_max_sink _kmers;
+    std::vector<std::string> _runs;
+};
+
+#endif //XPAS_ALGS_SPILL_H
@@ -0,0 +1,112 @@
+#include <stdexcept>
+
+#include "table.h"
+
+/// The finalizer of MurmurHash3: k-mer codes are far from uniform in the low bits
+static size_t mix(code_t code)
+{
+    auto key = fold(code);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+}
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t result = 1;
+    while (result < n)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+kmer_table::kmer_table(size_t capacity)
+    : _capacity(round_up_pow2(std::max(capacity, size_t{ 2 })))
+    , _mask(_capacity - 1)
+    , _keys(new std::atomic<code_t>[_capacity])
+    , _scores(new std::atomic<score_t>[_capacity])
+    , _size(0)
+{
+    for (size_t i = 0; i < _capacity; ++i)
+    {
+        _keys[i].store(empty_key, std::memory_order_relaxed);
+        _scores[i].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+void kmer_table::insert_max(code_t kmer, score_t score)
+{
+    size_t i = mix(kmer) & _mask;
+    for (size_t probe = 0; probe < _capacity; ++probe, i = (i + 1) & _mask)
+    {
+        auto key = _keys[i].load(std::memory_order_acquire);
+        if (key == empty_key)
+        {
+            // Claim the slot. If another thread was faster, key gets its k-mer
+            if (_keys[i].compare_exchange_strong(key, kmer, std::memory_order_acq_rel))
+            {
+                _size.fetch_add(1, std::memory_order_relaxed);
+                key = kmer;
+            }
+        }
+
+        if (key == kmer)
+        {
+            auto current = _scores[i].load(std::memory_order_relaxed);
+            while (score > current
+                   && !_scores[i].compare_exchange_weak(current, score, std::memory_order_relaxed))
+            {
+            }
+            return;
+        }
+    }
+    throw std::runtime_error("The k-mer table is full");
+}
+
+void kmer_table::insert_max(const std::vector<phylo_kmer>& kmers)
+{
+    for (const auto& [kmer, score] : kmers)
+    {
+        insert_max(kmer, score);
+    }
+}
+
+std::optional<score_t> kmer_table::get(code_t kmer) const
+{
+    size_t i = mix(kmer) & _mask;
+    for (size_t probe = 0; probe < _capacity; ++probe, i = (i + 1) & _mask)
+    {
+        const auto key = _keys[i].load(std::memory_order_acquire);
+        if (key == kmer)
+        {
+            return _scores[i].load(std::memory_order_relaxed);
+        }
+        else if (key == empty_key)
+        {
+            break;
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<phylo_kmer> kmer_table::to_vector() const
+{
+    std::vector<phylo_kmer> result;
+    result.reserve(size());
+    for_each([&result](code_t kmer, score_t score) { result.push_back({ kmer, score }); });
+    return result;
+}
+
+size_t kmer_table::size() const
+{
+    return _size.load(std::memory_order_relaxed);
+}
+
+size_t kmer_table::capacity() const
+{
+    return _capacity;
+}
@@ -0,0 +1,65 @@
+#ifndef XPAS_ALGS_TABLE_H
+#define XPAS_ALGS_TABLE_H
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include "common.h"
+
+/// A fixed-capacity open-addressing hash table of k-mers that keeps the best score of every k-mer.
+/// Many threads can insert at once: a slot is claimed by a CAS on its key,
+/// and the score is updated by a CAS loop that only lets it grow.
+///
+/// The all-ones code is reserved for empty slots, so k has to be less than 32.
+class kmer_table
+{
+public:
+    /// The capacity is rounded up to a power of two
+    explicit kmer_table(size_t capacity);
+    kmer_table(const kmer_table&) = delete;
+    kmer_table(kmer_table&&) = delete;
+    kmer_table& operator=(const kmer_table&) = delete;
+    kmer_table& operator=(kmer_table&&) = delete;
+    ~kmer_table() noexcept = default;
+
+    /// Inserts the k-mer, or updates its score if the new one is better. Thread-safe
+    void insert_max(code_t kmer, score_t score);
+
+    void insert_max(const std::vector<phylo_kmer>& kmers);
+
+    /// The best score of the k-mer. Not synchronized with concurrent inserts
+    std::optional<score_t> get(code_t kmer) const;
+
+    /// Calls f(kmer, score) for every k-mer. Not synchronized with concurrent inserts
+    template<typename F>
+    void for_each(F&& f) const
+    {
+        for (size_t i = 0; i < _capacity; ++i)
+        {
+            const auto key = _keys[i].load(std::memory_order_relaxed);
+            if (key != empty_key)
+            {
+                f(key, _scores[i].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    std::vector<phylo_kmer> to_vector() const;
+
+    size_t size() const;
+
+    size_t capacity() const;
+
+    static const code_t empty_key = ~code_t{ 0 };
+
+private:
+    size_t _capacity;
+    size_t _mask;
+
+    std::unique_ptr<std::atomic<code_t>[]> _keys;
+    std::unique_ptr<std::atomic<score_t>[]> _scores;
+
+    std::atomic<size_t> _size;
+};
+
+#endif //XPAS_ALGS_TABLE_H
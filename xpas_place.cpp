@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "database.h"
+#include "place.h"
+#include "pool.h"
+
+struct place_options
+{
+    /// The number of nodes reported per read
+    size_t top = 5;
+
+    size_t num_threads = 1;
+
+    /// The number of reads scored at once
+    size_t batch_size = 100000;
+
+    /// The log-score of a k-mer that is not stored for a node, the log of the threshold if not set
+    std::optional<double> penalty;
+};
+
+/// Scores the reads of a FASTA or FASTQ file against a phylo-k-mer database.
+/// Writes the best nodes of every read as lines of read, node and log-score, separated by tabs
+int main(int argc, char** argv)
+{
+    place_options options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--top" && i + 1 < argc)
+        {
+            options.top = std::stoul(argv[++i]);
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            options.batch_size = std::max(std::stoul(argv[++i]), 1ul);
+        }
+        else if (arg == "--penalty" && i + 1 < argc)
+        {
+            options.penalty = std::stod(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            /// 0 means all the hardware threads
+            options.num_threads = std::stoul(argv[++i]);
+            if (options.num_threads == 0)
+            {
+                options.num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() != 3)
+    {
+        std::cout << "Usage:\n\t" << argv[0] << " <database file> <FASTA/FASTQ file> "
+                  << "[--top N] [--threads N] [--batch N] [--penalty LOG_SCORE] OUTPUT_FILE" << std::endl;
+        return 1;
+    }
+
+    const kmer_database database(args[0]);
+    std::cout << "Database: " << database.num_codes() << " k-mers, " << database.num_nodes() << " nodes, k = "
+              << database.get_k() << ", omega = " << database.get_omega() << std::endl;
+
+    std::ifstream input(args[1]);
+    if (!input)
+    {
+        std::cerr << "Could not open " << args[1] << std::endl;
+        return 1;
+    }
+    std::ofstream output(args[2]);
+    if (!output)
+    {
+        std::cerr << "Could not open " << args[2] << std::endl;
+        return 1;
+    }
+    output << "read\tnode\tscore\n";
+
+    placement_scorer scorer = options.penalty
+        ? placement_scorer(database, options.top, *options.penalty)
+        : placement_scorer(database, options.top);
+    work_stealing_pool pool(options.num_threads);
+    query_reader reader(input);
+
+    const auto begin = std::chrono::steady_clock::now();
+    size_t num_reads = 0;
+    std::vector<query> batch;
+    while (reader.read(batch, options.batch_size))
+    {
+        const auto placements = scorer.score(batch, pool);
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            for (const auto& [node, score] : placements[i])
+            {
+                output << batch[i].name << '\t' << database.node_name(node) << '\t' << score << '\n';
+            }
+        }
+        num_reads += batch.size();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const auto seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "Placed " << num_reads << " reads in " << seconds << " s ("
+              << static_cast<size_t>(num_reads / std::max(seconds, 1e-9) * 60) << " reads per minute)" << std::endl;
+    return 0;
+}